@@ -0,0 +1,99 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+// Generates translation units holding variants of 16 to 512 alternatives,
+// instantiates every vah entry point on them and reports how long the
+// compiler front end takes and, where available, its peak memory. Code
+// generation is skipped so that template instantiation dominates.
+namespace {
+using Num = std::size_t;
+
+auto generateSource(Num const nAlternatives) -> std::string {
+  return "#include <csari/vah.hpp>\n"
+         "#include <cstdint>\n"
+         "template <std::size_t I>\n"
+         "struct Alternative { std::uint32_t value{I}; };\n"
+         "template <class Seq> struct VariantOf;\n"
+         "template <std::size_t... Is>\n"
+         "struct VariantOf<std::index_sequence<Is...>> {\n"
+         "  using type = std::variant<Alternative<Is>...>;\n"
+         "};\n"
+         "constexpr std::size_t N = " +
+         std::to_string(nAlternatives) +
+         ";\n"
+         "using V = VariantOf<std::make_index_sequence<N>>::type;\n"
+         "template <std::size_t... Is>\n"
+         "auto instantiate(std::index_sequence<Is...>) -> std::size_t {\n"
+         "  using namespace csari::vah;\n"
+         "  auto sum = std::size_t{};\n"
+         "  auto const f = [&sum](auto const& val) { sum += val.value; };\n"
+         "  auto var = constructVariantFromIndexRuntime<V>(N - 1);\n"
+         "  performOnData(var, f);\n"
+         "  sum += performOnDataR(var, [](auto const& val) {\n"
+         "    return std::size_t{val.value};\n"
+         "  });\n"
+         "  sum += constructAndPerformOnData<V>(0, f).index();\n"
+         "  sum += constructVariantFromIndexConstexpr<N - 1, V>().index();\n"
+         "  sum += (VariantIndex<V, Alternative<Is>> + ...);\n"
+         "  return sum;\n"
+         "}\n"
+         "auto main() -> int {\n"
+         "  return static_cast<int>(instantiate(std::make_index_sequence<N>{}));\n"
+         "}\n";
+}
+
+auto compileCommand(std::string const& source) -> std::string {
+  auto const compiler = std::string{"\"" VAH_CXX_COMPILER "\""};
+  auto const include = std::string{"\"" VAH_INCLUDE_DIR "\""};
+#if defined(_MSC_VER)
+  return compiler + " /nologo /std:c++17 /EHsc /bigobj /Zs /I" + include +
+         " " + source;
+#else
+  return compiler + " -std=c++17 -fsyntax-only -I" + include + " " + source;
+#endif
+}
+
+// Peak resident memory of the largest child process so far, in MiB
+auto peakChildMemoryMiB() -> double {
+#if defined(_WIN32)
+  return 0.0;
+#else
+  auto usage = rusage{};
+  getrusage(RUSAGE_CHILDREN, &usage);
+#if defined(__APPLE__)
+  return static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+  return static_cast<double>(usage.ru_maxrss) / 1024.0;
+#endif
+#endif
+}
+}  // namespace
+
+auto main() -> int {
+  std::printf("%6s %10s %14s\n", "N", "time", "peak memory");
+  for (auto const nAlternatives : {16U, 32U, 64U, 128U, 256U, 512U}) {
+    auto const source =
+        "vah_compile_time_" + std::to_string(nAlternatives) + ".cpp";
+    std::ofstream{source} << generateSource(nAlternatives);
+    auto const start = std::chrono::steady_clock::now();
+    auto const status = std::system(compileCommand(source).c_str());
+    auto const stop = std::chrono::steady_clock::now();
+    if (status != 0) {
+      std::printf("%6u compilation failed\n", nAlternatives);
+      return EXIT_FAILURE;
+    }
+    // Children run one after another and grow with N, so the running maximum
+    // belongs to the current compilation
+    std::printf("%6u %9.2fs %10.1f MiB\n", nAlternatives,
+                std::chrono::duration<double>(stop - start).count(),
+                peakChildMemoryMiB());
+    std::fflush(stdout);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <csari/vah.hpp>
+#include <csari/vah/index_kernels.hpp>
+#include <csari/vah/partition.hpp>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+using Num = std::size_t;
+auto constexpr nElements = Num{1U << 16U};
+auto constexpr nRepetitions = 15;
+
+template <Num I>
+struct Alternative final {
+  static constexpr Num index = I;
+  std::uint32_t value{I};
+};
+template <class Seq>
+struct VariantOfImplementation;
+template <Num... Is>
+struct VariantOfImplementation<std::index_sequence<Is...>> {
+  using type = std::variant<Alternative<Is>...>;
+};
+template <Num N>
+using VariantOf =
+    typename VariantOfImplementation<std::make_index_sequence<N>>::type;
+
+enum class Distribution { uniform, skewed, sorted };
+auto distributionName(Distribution const distribution) -> char const* {
+  switch (distribution) {
+    case Distribution::uniform:
+      return "uniform";
+    case Distribution::skewed:
+      return "skewed";
+    case Distribution::sorted:
+      return "sorted";
+  }
+  return "";
+}
+
+auto makeIndices(Num const nAlternatives, Distribution const distribution)
+    -> std::vector<Num> {
+  auto engine = std::mt19937_64{42U};
+  auto indices = std::vector<Num>(nElements);
+  if (distribution == Distribution::skewed) {
+    // Roughly half of the elements hold the first alternative, a quarter the
+    // second and so on
+    auto dist = std::geometric_distribution<Num>{0.5};
+    std::generate(begin(indices), end(indices), [&] {
+      return std::min(dist(engine), nAlternatives - 1U);
+    });
+  } else {
+    auto dist = std::uniform_int_distribution<Num>{0U, nAlternatives - 1U};
+    std::generate(begin(indices), end(indices), [&] { return dist(engine); });
+  }
+  if (distribution == Distribution::sorted) {
+    std::sort(begin(indices), end(indices));
+  }
+  return indices;
+}
+
+// Best of nRepetitions, divided by the number of operations in one run
+template <class Op>
+auto measureNsPerOp(Op op) -> double {
+  auto best = std::numeric_limits<double>::max();
+  for (auto repetition = 0; repetition < nRepetitions; ++repetition) {
+    auto const start = std::chrono::steady_clock::now();
+    op();
+    auto const stop = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::nano>(stop - start).count());
+  }
+  return best / static_cast<double>(nElements);
+}
+
+// Keeps the optimizer from dropping the measured work
+std::uint64_t volatile sink;
+
+#define VAH_BENCH_CASE(I)                         \
+  case (I):                                       \
+    if constexpr ((I) < std::variant_size_v<V>) { \
+      f(*std::get_if<(I)>(&var));                 \
+    }                                             \
+    break;
+#define VAH_BENCH_CASE4(I) \
+  VAH_BENCH_CASE(I)        \
+  VAH_BENCH_CASE(I + 1)    \
+  VAH_BENCH_CASE(I + 2)    \
+  VAH_BENCH_CASE(I + 3)
+#define VAH_BENCH_CASE16(I) \
+  VAH_BENCH_CASE4(I)        \
+  VAH_BENCH_CASE4(I + 4)    \
+  VAH_BENCH_CASE4(I + 8)    \
+  VAH_BENCH_CASE4(I + 12)
+#define VAH_BENCH_CASE64(I) \
+  VAH_BENCH_CASE16(I)       \
+  VAH_BENCH_CASE16(I + 16)  \
+  VAH_BENCH_CASE16(I + 32)  \
+  VAH_BENCH_CASE16(I + 48)
+
+// Hand written switch, supports up to 128 alternatives
+template <class V, class F>
+void visitWithSwitch(V const& var, F f) {
+  static_assert(std::variant_size_v<V> <= 128U);
+  switch (var.index()) {
+    VAH_BENCH_CASE64(0)
+    VAH_BENCH_CASE64(64)
+    default:
+      break;
+  }
+}
+
+void report(char const* name, Num const nAlternatives,
+            Distribution const distribution, double const nsPerOp) {
+  std::printf("%-28s %5zu %-8s %8.3f ns/op\n", name, nAlternatives,
+              distributionName(distribution), nsPerOp);
+}
+
+template <Num N>
+void benchmarkAlternatives(Distribution const distribution) {
+  using namespace csari::vah;
+  using V = VariantOf<N>;
+  auto const indices = makeIndices(N, distribution);
+  auto variants = std::vector<V>{};
+  variants.reserve(nElements);
+  for (auto const index : indices) {
+    variants.push_back(constructVariantFromIndexRuntime<V>(index));
+  }
+  auto sum = std::uint64_t{};
+  // Distinct work per alternative so that the branches cannot be merged
+  auto const fSum = [&sum](auto const& val) {
+    sum += val.value << (std::decay_t<decltype(val)>::index % 8U);
+  };
+
+  report("performOnData table", N, distribution, measureNsPerOp([&] {
+           for (auto const& var : variants) {
+             performOnData<Dispatch::table>(var, fSum);
+           }
+         }));
+  report("performOnData expander", N, distribution, measureNsPerOp([&] {
+           for (auto const& var : variants) {
+             performOnData<Dispatch::expander>(var, fSum);
+           }
+         }));
+  report("performOnRange", N, distribution,
+         measureNsPerOp([&] { performOnRange(variants, fSum); }));
+  report("std::visit", N, distribution, measureNsPerOp([&] {
+           for (auto const& var : variants) {
+             std::visit(fSum, var);
+           }
+         }));
+  report("switch", N, distribution, measureNsPerOp([&] {
+           for (auto const& var : variants) {
+             visitWithSwitch(var, fSum);
+           }
+         }));
+  report("constructVariantFromIndex", N, distribution, measureNsPerOp([&] {
+           for (auto const index : indices) {
+             sum += constructVariantFromIndexRuntime<V>(index).index();
+           }
+         }));
+  report("constructAndPerformOnData", N, distribution, measureNsPerOp([&] {
+           for (auto const index : indices) {
+             auto const var = constructAndPerformOnData<V>(
+                 index, [index](auto& val) {
+                   val.value = static_cast<std::uint32_t>(index);
+                 });
+             sum += var.index();
+           }
+         }));
+  auto histogram = std::array<Num, N>{};
+  report("histogram performOnData", N, distribution, measureNsPerOp([&] {
+           for (auto const& var : variants) {
+             performOnData(var, [&histogram](auto const& val) {
+               ++histogram[std::decay_t<decltype(val)>::index];
+             });
+           }
+         }));
+  auto tags = std::vector<std::uint8_t>{};
+  tags.reserve(nElements);
+  for (auto const& var : variants) {
+    tags.push_back(static_cast<std::uint8_t>(var.index()));
+  }
+  report("indexHistogram", N, distribution, measureNsPerOp([&] {
+           histogram = indexHistogram<V>(tags.data(), tags.size());
+         }));
+  auto selected = std::vector<Num>{};
+  selected.reserve(nElements);
+  report("indicesOf", N, distribution, measureNsPerOp([&] {
+           selected.clear();
+           indicesOf(tags.data(), tags.size(), 0U,
+                     std::back_inserter(selected));
+         }));
+  auto partitioned = variants;
+  report("partition_by_index", N, distribution, measureNsPerOp([&] {
+           partitioned = variants;
+           partition_by_index(partitioned);
+         }));
+  auto const parts = partition_by_index(partitioned);
+  report("partitioned for_each", N, distribution,
+         measureNsPerOp([&] { parts.for_each(fSum); }));
+  sum += histogram[0] + selected.size();
+  sink = sum;
+}
+
+template <Num N>
+void benchmarkAlternatives() {
+  for (auto const distribution :
+       {Distribution::uniform, Distribution::skewed, Distribution::sorted}) {
+    benchmarkAlternatives<N>(distribution);
+  }
+}
+}  // namespace
+
+auto main() -> int {
+  std::printf("%-28s %5s %-8s %14s\n", "operation", "N", "indices", "time");
+  benchmarkAlternatives<2>();
+  benchmarkAlternatives<8>();
+  benchmarkAlternatives<32>();
+  benchmarkAlternatives<128>();
+  return 0;
+}
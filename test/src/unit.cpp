@@ -1,7 +1,22 @@
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 #include <csari/vah.hpp>
+#include <csari/vah/bucket_vector.hpp>
+#include <csari/vah/compact_variant.hpp>
+#include <csari/vah/index_kernels.hpp>
+#include <csari/vah/niche_variant.hpp>
+#include <csari/vah/parallel.hpp>
+#include <csari/vah/partition.hpp>
+#include <csari/vah/serialize.hpp>
+#include <csari/vah/split_variant_vector.hpp>
+#include <csari/vah/stream_view.hpp>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 
 struct VariantConstexprPerformer final {
   constexpr VariantConstexprPerformer(char const cVal = 'c',
@@ -30,6 +45,30 @@ TEST_CASE("VahVariantStructAccessAndUpdate") {
   REQUIRE(std::get<int>(var) == 94);
 }
 
+template <std::size_t I>
+struct Tag {};
+template <class Seq>
+struct TagVariant;
+template <std::size_t... Is>
+struct TagVariant<std::index_sequence<Is...>> {
+  using type = std::variant<Tag<Is>...>;
+};
+
+TEST_CASE("VahVariantIndexLargeVariant") {
+  using namespace csari::vah;
+  using V = std::variant<int, char, int, float>;
+  STATIC_REQUIRE(VariantIndex<V, char> == 1);
+  STATIC_REQUIRE(VariantIndex<V, float> == 3);
+  // int appears twice, the start index picks the occurrence
+  STATIC_REQUIRE(VariantIndex<V, int, 0> == 0);
+  STATIC_REQUIRE(VariantIndex<V, int, 1> == 2);
+  STATIC_REQUIRE(VariantIndex<V, double, 0> == 4);
+  using L = TagVariant<std::make_index_sequence<256>>::type;
+  STATIC_REQUIRE(VariantIndex<L, Tag<255>> == 255);
+  REQUIRE(constructVariantFromIndexConstexpr<255, L>().index() == 255);
+  REQUIRE(constructVariantFromIndexConstexpr<300, L>().index() == 255);
+}
+
 TEST_CASE("VahVariantLambdaConstructAndUpdate") {
   using namespace csari::vah;
   using V = std::variant<int, float, char>;
@@ -99,6 +138,431 @@ TEST_CASE("VahVariantConstexprStructAccessAndUpdate") {
   REQUIRE(std::get<int>(var) == 94);
 }
 
+TEST_CASE("VahDispatchStrategies") {
+  using namespace csari::vah;
+  using V = std::variant<char, short, int, long, float, double, char const*>;
+  auto const fSize = [](std::size_t& size) {
+    return [&size](auto const& val) { size = sizeof(val); };
+  };
+  for (auto index = std::size_t{}; index < std::variant_size_v<V>; ++index) {
+    auto const var = constructVariantFromIndexRuntime<V>(index);
+    auto sizeTable = std::size_t{};
+    auto sizeExpander = std::size_t{};
+    performOnData<Dispatch::table>(var, fSize(sizeTable));
+    performOnData<Dispatch::expander>(var, fSize(sizeExpander));
+    REQUIRE(sizeTable == sizeExpander);
+    REQUIRE(sizeTable > 0U);
+  }
+}
+
+TEST_CASE("VahConstructRuntimeForwardsParams") {
+  using namespace csari::vah;
+  using V = std::variant<std::unique_ptr<int>, std::shared_ptr<int>>;
+  auto var = constructVariantFromIndexRuntime<V>(
+      VariantIndex<V, std::shared_ptr<int>>, std::make_unique<int>(5));
+  REQUIRE(*std::get<std::shared_ptr<int>>(var) == 5);
+  // Out of range indices fall back to the first alternative
+  var = constructVariantFromIndexRuntime<V>(std::variant_size_v<V>);
+  REQUIRE(var.index() == 0U);
+}
+
+TEST_CASE("VahConstructAndPerformCallsOnce") {
+  using namespace csari::vah;
+  using V = std::variant<int, float, char>;
+  auto nCalls = 0;
+  auto const fCount = [&nCalls](auto& val) {
+    ++nCalls;
+    val = 7;
+  };
+  auto const var = constructAndPerformOnData<V>(VariantIndex<V, float>, fCount);
+  REQUIRE(std::get<float>(var) == 7.f);
+  REQUIRE(nCalls == 1);
+  auto const varOutOfRange =
+      constructAndPerformOnData<V>(std::variant_size_v<V>, fCount);
+  REQUIRE(varOutOfRange.index() == 0U);
+  REQUIRE(nCalls == 1);
+}
+
+TEST_CASE("VahEmplaceFromIndexRuntime") {
+  using namespace csari::vah;
+  using V = std::variant<std::string, std::vector<char>>;
+  auto var = V{};
+  emplaceFromIndexRuntime(var, VariantIndex<V, std::string>, 3U, 'x');
+  REQUIRE(std::get<std::string>(var) == "xxx");
+  emplaceAndPerformOnData(
+      var, VariantIndex<V, std::vector<char>>,
+      [](auto& val) { val.push_back('y'); }, 2U, 'x');
+  REQUIRE(std::get<std::vector<char>>(var) == std::vector<char>{'x', 'x', 'y'});
+}
+
+TEST_CASE("VahTryConstructRejectsOutOfRange") {
+  using namespace csari::vah;
+  using V = std::variant<int, float, char>;
+  auto const var = tryConstructVariantFromIndexRuntime<V>(2U, 'a');
+  REQUIRE(var.has_value());
+  REQUIRE(std::get<char>(*var) == 'a');
+  REQUIRE_FALSE(tryConstructVariantFromIndexRuntime<V>(3U).has_value());
+
+  auto nCalls = 0;
+  auto const fCount = [&nCalls](auto&) { ++nCalls; };
+  REQUIRE(tryConstructAndPerformOnData<V>(1U, fCount).has_value());
+  REQUIRE_FALSE(tryConstructAndPerformOnData<V>(42U, fCount).has_value());
+  REQUIRE(nCalls == 1);
+}
+
+TEST_CASE("VahPerformOnDataReturnsResult") {
+  using namespace csari::vah;
+  using V = std::variant<int, double, std::string>;
+  auto const fSize = [](auto const& val) { return sizeof(val); };
+  auto const var = V{std::string{"vah"}};
+  REQUIRE(performOnDataR(var, fSize) == sizeof(std::string));
+  auto const fIsText = [](auto const& val) {
+    return std::is_same_v<std::decay_t<decltype(val)>, std::string>;
+  };
+  REQUIRE(performOnDataR<int>(var, fIsText) == 1);
+
+  auto varTwin = std::variant<int, int>{std::in_place_index<1>, 3};
+  performOnDataR(varTwin, [](auto& val) -> auto& { return val; }) = 5;
+  REQUIRE(std::get<1>(varTwin) == 5);
+}
+
+TEST_CASE("VahPerformOnMultipleVariants") {
+  using namespace csari::vah;
+  using V = std::variant<int, float, double>;
+  auto const lhs = V{2};
+  auto const rhs = V{0.5};
+  auto const fAdd = [](auto const a, auto const b) -> double { return a + b; };
+  REQUIRE(performOnDataR(fAdd, lhs, rhs) == 2.5);
+
+  auto nCalls = 0;
+  auto sum = 0.0;
+  auto var3 = std::variant<char, long>{3L};
+  performOnData(
+      [&nCalls, &sum](auto const a, auto const b, auto& c) {
+        ++nCalls;
+        sum = a + b + c;
+        c = 0;
+      },
+      lhs, rhs, var3);
+  REQUIRE(nCalls == 1);
+  REQUIRE(sum == 5.5);
+  REQUIRE(std::get<long>(var3) == 0L);
+
+  // The result of f is discarded, as with a single variant
+  auto nAdds = 0;
+  performOnData(
+      [&nAdds](auto const a, auto const b) {
+        ++nAdds;
+        return a + b;
+      },
+      lhs, rhs);
+  REQUIRE(nAdds == 1);
+  // int + double yields double, int + int yields int, so a deduced result
+  // would not compile and R has to be given
+  auto const one = V{1};
+  auto const fAddAny = [](auto const a, auto const b) { return a + b; };
+  REQUIRE(performOnDataR<double>(fAddAny, one, rhs) == 1.5);
+  REQUIRE(performOnDataR<double>(fAddAny, one, one) == 2.0);
+}
+
+TEST_CASE("VahPerformOnRange") {
+  using namespace csari::vah;
+  using V = std::variant<int, char, std::string>;
+  auto vecVar = std::vector<V>{1, 2, 'a', 'b', 'c', std::string{"d"}, 3};
+  auto visited = std::string{};
+  auto const fAppend = [&visited](auto const& val) {
+    using U = std::decay_t<decltype(val)>;
+    if constexpr (std::is_same_v<U, int>) {
+      visited += std::to_string(val);
+    } else {
+      visited += val;
+    }
+  };
+  performOnRange(begin(vecVar), end(vecVar), fAppend);
+  REQUIRE(visited == "12abcd3");
+
+  performOnRange(vecVar, [](auto& val) { val = val + val; });
+  REQUIRE(std::get<int>(vecVar.back()) == 6);
+  REQUIRE(std::get<std::string>(vecVar[5]) == "dd");
+  auto const* const pFirst = vecVar.data();
+  visited.clear();
+  performOnRange(pFirst, pFirst + 2, fAppend);
+  REQUIRE(visited == "24");
+}
+
+TEST_CASE("VahBucketVector") {
+  using namespace csari::vah;
+  using V = std::variant<char, double, std::string>;
+  auto buckets = bucket_vector<V>{};
+  for (auto const& var : std::vector<V>{'a', 1.5, std::string{"bc"}, 'd', 2.5}) {
+    buckets.push_back(var);
+  }
+  buckets.emplace_back<std::string>(2U, 'e');
+  REQUIRE(buckets.size() == 6U);
+  REQUIRE(buckets.bucket<char>() == std::vector<char>{'a', 'd'});
+  REQUIRE(buckets.bucket<2>() == std::vector<std::string>{"bc", "ee"});
+
+  auto sum = 0.0;
+  auto text = std::string{};
+  buckets.for_each([&sum, &text](auto const& val) {
+    if constexpr (std::is_same_v<std::decay_t<decltype(val)>, double>) {
+      sum += val;
+    } else {
+      text += val;
+    }
+  });
+  REQUIRE(sum == 4.0);
+  REQUIRE(text == "adbcee");
+  buckets.clear();
+  REQUIRE(buckets.empty());
+}
+
+TEST_CASE("VahSplitVariantVector") {
+  using namespace csari::vah;
+  using V = std::variant<char, std::uint32_t, double>;
+  auto vec = split_variant_vector<V>{};
+  STATIC_REQUIRE(sizeof(split_variant_vector<V>::tag_type) == 1U);
+  for (auto k = 0U; k < 10U; ++k) {
+    vec.push_back(k % 3U == 0U ? V{static_cast<double>(k)} : V{'a'});
+  }
+  vec.emplace_back<std::uint32_t>(7U);
+  REQUIRE(vec.size() == 11U);
+  REQUIRE(vec.count<double>() == 4U);
+  REQUIRE(vec.count<char>() == 6U);
+  REQUIRE(vec.find<std::uint32_t>() == 10U);
+  REQUIRE(vec.find<double>(1U) == 3U);
+  REQUIRE(vec.find<double>(10U) == vec.size());
+  REQUIRE(vec.index(3U) == 2U);
+  REQUIRE(vec.at(6U) == V{6.0});
+
+  auto sum = 0.0;
+  vec.for_each([&sum](auto const& val) { sum += val; });
+  REQUIRE(sum == 18.0 + 6 * 'a' + 7);
+  vec.perform(10U, [](auto& val) { val = 8; });
+  REQUIRE(vec.at(10U) == V{std::uint32_t{8U}});
+
+  REQUIRE(vec.partition<double>() == 4U);
+  auto doubles = 0.0;
+  for (auto k = 0U; k < 4U; ++k) {
+    REQUIRE(vec.index(k) == 2U);
+    vec.perform(k, [&doubles](auto const& val) { doubles += val; });
+  }
+  REQUIRE(doubles == 18.0);
+  REQUIRE(vec.count<char>() == 6U);
+  REQUIRE(vec.find<double>(4U) == vec.size());
+
+  // Long enough for whole blocks of 64 indices and a tail
+  vec.clear();
+  for (auto k = 0U; k < 200U; ++k) {
+    vec.push_back(k == 70U || k == 150U || k == 199U ? V{1.5} : V{'b'});
+  }
+  REQUIRE(vec.count<double>() == 3U);
+  REQUIRE(vec.count<char>() == 197U);
+  REQUIRE(vec.count<std::uint32_t>() == 0U);
+  REQUIRE(vec.find<double>() == 70U);
+  REQUIRE(vec.find<double>(71U) == 150U);
+  REQUIRE(vec.find<double>(151U) == 199U);
+  REQUIRE(vec.find<std::uint32_t>() == vec.size());
+  REQUIRE(vec.find<char>(300U) == vec.size());
+}
+
+template <class Tag, class V>
+void requireIndexKernelsMatch(std::vector<Tag> const& tags) {
+  using namespace csari::vah;
+  auto expected = std::array<std::size_t, std::variant_size_v<V>>{};
+  for (auto const tag : tags) {
+    ++expected[tag];
+  }
+  REQUIRE(indexHistogram<V>(tags.data(), tags.size()) == expected);
+  auto const index = std::size_t{2};
+  auto bitmap = std::vector<std::uint64_t>((tags.size() + 63U) / 64U, ~0U);
+  selectIndex(tags.data(), tags.size(), index, bitmap.data());
+  auto selected = std::vector<std::size_t>{};
+  indicesOf(tags.data(), tags.size(), index, std::back_inserter(selected));
+  REQUIRE(selected.size() == expected[index]);
+  auto next = selected.begin();
+  for (auto k = std::size_t{}; k < tags.size(); ++k) {
+    auto const isSelected = tags[k] == index;
+    REQUIRE(((bitmap[k / 64U] >> (k % 64U)) & 1U) == isSelected);
+    if (isSelected) {
+      REQUIRE(*next++ == k);
+    }
+  }
+}
+
+TEST_CASE("VahIndexKernels") {
+  using Small = std::variant<char, int, float, double>;
+  using Large = TagVariant<std::make_index_sequence<12>>::type;
+  // Not a multiple of the 64 tag blocks
+  auto tags = std::vector<std::uint8_t>(1000U);
+  for (auto k = std::size_t{}; k < tags.size(); ++k) {
+    tags[k] = static_cast<std::uint8_t>((k * 7U + k / 5U) % 4U);
+  }
+  requireIndexKernelsMatch<std::uint8_t, Small>(tags);
+  for (auto k = std::size_t{}; k < tags.size(); ++k) {
+    tags[k] = static_cast<std::uint8_t>((k * 5U) % 12U);
+  }
+  requireIndexKernelsMatch<std::uint8_t, Large>(tags);
+  auto wideTags = std::vector<std::uint16_t>(tags.begin(), tags.end());
+  requireIndexKernelsMatch<std::uint16_t, Large>(wideTags);
+
+  auto vec = csari::vah::split_variant_vector<Small>{};
+  vec.emplace_back<int>(1);
+  vec.emplace_back<char>('a');
+  vec.emplace_back<int>(2);
+  auto ints = std::vector<std::size_t>{};
+  csari::vah::indicesOf(vec.indices().data(), vec.size(), 1U,
+                        std::back_inserter(ints));
+  REQUIRE(ints == std::vector<std::size_t>{0U, 2U});
+}
+
+TEST_CASE("VahPartitionByIndex") {
+  using V = std::variant<int, double, std::string>;
+  auto const make = [](std::size_t const k) -> V {
+    switch ((k * 7U + k / 3U) % 3U) {
+      case 0U:
+        return static_cast<int>(k);
+      case 1U:
+        return static_cast<double>(k);
+      default:
+        return std::to_string(k);
+    }
+  };
+  // Large enough for several threads, the order within a group must hold
+  for (auto const nThreads : {1U, 4U}) {
+    auto vec = std::vector<V>{};
+    for (auto k = std::size_t{}; k < 200000U; ++k) {
+      vec.push_back(make(k));
+    }
+    auto expected = vec;
+    std::stable_sort(expected.begin(), expected.end(),
+                     [](V const& lhs, V const& rhs) {
+                       return lhs.index() < rhs.index();
+                     });
+    auto const parts = csari::vah::partition_by_index(vec, nThreads);
+    REQUIRE(vec == expected);
+    REQUIRE(parts.begin<int>() == vec.begin());
+    REQUIRE(parts.end<std::string>() == vec.end());
+    REQUIRE(parts.size<0>() + parts.size<1>() + parts.size<2>() ==
+            vec.size());
+    REQUIRE(std::all_of(parts.begin<double>(), parts.end<double>(),
+                        [](V const& var) { return var.index() == 1U; }));
+    auto sum = 0.0;
+    parts.for_each<double>([&sum](double& val) { sum += val; });
+    auto expectedSum = 0.0;
+    for (auto it = parts.begin<1>(); it != parts.end<1>(); ++it) {
+      expectedSum += std::get<double>(*it);
+    }
+    REQUIRE(sum == expectedSum);
+  }
+
+  auto deq = std::deque<V>{V{"a"}, V{1}, V{2.5}, V{2}, V{"b"}};
+  auto const parts = csari::vah::partition_by_index(deq);
+  REQUIRE(deq == std::deque<V>{V{1}, V{2}, V{2.5}, V{"a"}, V{"b"}});
+  auto visited = std::string{};
+  parts.for_each([&visited](auto const& val) {
+    using T = std::decay_t<decltype(val)>;
+    if constexpr (std::is_same_v<T, int>) {
+      visited += 'i';
+    } else if constexpr (std::is_same_v<T, double>) {
+      visited += 'd';
+    } else {
+      visited += val;
+    }
+  });
+  REQUIRE(visited == "iidab");
+}
+
+TEST_CASE("VahCompactVariant") {
+  using namespace csari::vah;
+  using V = compact_variant<char, std::int16_t, double>;
+  STATIC_REQUIRE(sizeof(compact_variant<char, std::int16_t>) == 4U);
+  STATIC_REQUIRE(sizeof(compact_variant<char, std::int16_t>) <=
+                 sizeof(std::variant<char, std::int16_t>));
+  STATIC_REQUIRE(std::is_trivially_copyable_v<V>);
+  STATIC_REQUIRE(VariantIndex<V, double> == 2U);
+
+  auto var = constructVariantFromIndexRuntime<V>(1U, std::int16_t{7});
+  REQUIRE(var.index() == 1U);
+  REQUIRE(get<std::int16_t>(var) == 7);
+  REQUIRE_THROWS_AS(get<char>(var), std::bad_variant_access);
+  performOnData(var, [](auto& val) { val *= 3; });
+  REQUIRE(get<1>(var) == 21);
+  REQUIRE(performOnDataR(var, [](auto const& val) {
+            return static_cast<double>(val);
+          }) == 21.0);
+
+  auto const loaded = constructAndPerformOnData<V>(
+      VariantIndex<V, double>, [](auto& val) { val = 2.5; });
+  REQUIRE(holds_alternative<double>(loaded));
+  REQUIRE(loaded == V{2.5});
+  REQUIRE(loaded != V{'x'});
+  emplaceFromIndexRuntime(var, 0U, 'q');
+  REQUIRE(var == V{'q'});
+}
+
+enum class Level : std::uint8_t { low, high, unset = 0xFF };
+template <>
+struct csari::vah::niche_traits<Level> {
+  static constexpr std::size_t count = 1U;
+  static auto niche(std::size_t /*unused*/) -> Level { return Level::unset; }
+  static auto niche_index(Level const val) -> std::size_t {
+    return val == Level::unset ? 0U : count;
+  }
+};
+struct Pending {};
+
+TEST_CASE("VahNicheVariant") {
+  using namespace csari::vah;
+  using P = niche_variant<std::monostate, int*>;
+  STATIC_REQUIRE(sizeof(P) == sizeof(int*));
+  auto value = 5;
+  auto ptr = P{};
+  REQUIRE(holds_alternative<std::monostate>(ptr));
+  ptr = P{&value};
+  REQUIRE(ptr.index() == 1U);
+  performOnData(ptr, [](auto& val) {
+    if constexpr (std::is_same_v<std::decay_t<decltype(val)>, int*>) {
+      *val = 6;
+    }
+  });
+  REQUIRE(value == 6);
+  ptr = P{static_cast<int*>(nullptr)};
+  REQUIRE(ptr.index() == 1U);
+  REQUIRE(get<int*>(ptr) == nullptr);
+
+  using L = niche_variant<Pending, Level>;
+  STATIC_REQUIRE(sizeof(L) == 1U);
+  STATIC_REQUIRE(VariantIndex<L, Level> == 1U);
+  auto level = constructVariantFromIndexRuntime<L>(0U);
+  REQUIRE(holds_alternative<Pending>(level));
+  REQUIRE_THROWS_AS(get<Level>(level), std::bad_variant_access);
+  emplaceAndPerformOnData(level, 1U, [](auto& val) {
+    if constexpr (std::is_same_v<std::decay_t<decltype(val)>, Level>) {
+      val = Level::high;
+    }
+  });
+  REQUIRE(level == L{Level::high});
+  REQUIRE(level != L{Pending{}});
+  REQUIRE(performOnDataR(level, [](auto const& val) {
+            return std::is_same_v<std::decay_t<decltype(val)>, Pending>;
+          }) == false);
+}
+
+constexpr auto constexprTableReturn() -> int {
+  auto const var = std::variant<char, int>{std::in_place_index<1>, 3};
+  return csari::vah::performOnDataR(
+      var, [](auto const val) constexpr { return static_cast<int>(val) * 2; });
+}
+static_assert(constexprTableReturn() == 6);
+
+constexpr auto constexprTableDispatch() -> int {
+  auto var = std::variant<char, int>{std::in_place_index<1>, 3};
+  csari::vah::performOnData(var, [](auto& val) constexpr { val += 4; });
+  return std::get<int>(var);
+}
+static_assert(constexprTableDispatch() == 7);
+
 template <class V>
 auto serializeVariantVector(std::vector<V> const& vecVar) -> std::string {
   auto ss = std::stringstream{};
@@ -107,7 +571,7 @@ auto serializeVariantVector(std::vector<V> const& vecVar) -> std::string {
   };
   fWriteStream(size(vecVar));
   std::for_each(begin(vecVar), end(vecVar), [&fWriteStream](V const& var) {
-    fWriteStream(var.index());
+    fWriteStream(static_cast<csari::vah::VariantIndexTag<V>>(var.index()));
     csari::vah::performOnData(
         var, [&fWriteStream](auto& val) { fWriteStream(val); });
   });
@@ -126,7 +590,7 @@ auto loadVariantVector(std::string&& serializedData) -> std::vector<V> {
   dataVectorLoaded.reserve(nElements);
   std::generate_n(std::back_inserter(dataVectorLoaded), nElements,
                   [&fReadStream] {
-                    auto index = std::size_t{};
+                    auto index = csari::vah::VariantIndexTag<V>{};
                     fReadStream(index);
                     return csari::vah::constructAndPerformOnData<V>(
                         index, [&fReadStream](auto& val) { fReadStream(val); });
@@ -142,3 +606,285 @@ TEST_CASE("VahSerializationTest") {
   REQUIRE(size(dataVector) == size(dataVectorLoaded));
   REQUIRE(equal(begin(dataVector), end(dataVector), begin(dataVectorLoaded)));
 }
+
+TEST_CASE("VahBinarySerialization") {
+  using namespace csari::vah;
+  using V = std::variant<std::uint32_t, char, double>;
+  auto const dataVector = std::vector<V>{std::uint32_t{42U}, 'a', 2.5, 'b'};
+  auto buffer = std::array<std::byte, 64>{};
+  auto* out = buffer.data();
+  for (auto const& var : dataVector) {
+    REQUIRE(serialize(var, out, buffer.data() + buffer.size()));
+  }
+  auto const* const end = out;
+  REQUIRE(end - buffer.data() == 1 + 4 + 1 + 1 + 1 + 8 + 1 + 1);
+
+  auto dataVectorLoaded = std::vector<V>{};
+  auto const* in = static_cast<std::byte const*>(buffer.data());
+  while (auto var = deserialize<V>(in, end)) {
+    dataVectorLoaded.push_back(*var);
+  }
+  REQUIRE(in == end);
+  REQUIRE(dataVectorLoaded == dataVector);
+
+  SECTION("Rejects truncated buffers") {
+    auto* small = buffer.data();
+    REQUIRE_FALSE(serialize(V{2.5}, small, buffer.data() + 8));
+    REQUIRE(small == buffer.data());
+    auto const* truncated = static_cast<std::byte const*>(buffer.data());
+    REQUIRE_FALSE(deserialize<V>(truncated, truncated + 3));
+    REQUIRE(truncated == buffer.data());
+  }
+  SECTION("Rejects unknown indices") {
+    buffer[0] = std::byte{3};
+    auto const* unknown = static_cast<std::byte const*>(buffer.data());
+    REQUIRE_FALSE(deserialize<V>(unknown, end));
+    REQUIRE(unknown == buffer.data());
+  }
+  SECTION("Stream header") {
+    auto header = std::array<std::byte, 8>{};
+    auto* headerOut = header.data();
+    REQUIRE(serializeHeader<V>(headerOut, header.data() + header.size()));
+    auto const* headerIn = static_cast<std::byte const*>(header.data());
+    REQUIRE_FALSE(deserializeHeader<std::variant<std::uint32_t, char>>(
+        headerIn, headerOut));
+    REQUIRE(headerIn == header.data());
+    REQUIRE(deserializeHeader<V>(headerIn, headerOut));
+    REQUIRE(headerIn == headerOut);
+  }
+  SECTION("Varint tags") {
+    using L = TagVariant<std::make_index_sequence<200>>::type;
+    auto* varintOut = buffer.data();
+    REQUIRE(serializedSize<TagEncoding::varint>(L{Tag<3>{}}) == 1 + 1);
+    REQUIRE(serializedSize<TagEncoding::varint>(L{Tag<130>{}}) == 2 + 1);
+    REQUIRE(serialize<TagEncoding::varint>(L{Tag<130>{}}, varintOut,
+                                           buffer.data() + buffer.size()));
+    REQUIRE(buffer[0] == std::byte{0x82});
+    REQUIRE(buffer[1] == std::byte{0x01});
+    auto const* varintIn = static_cast<std::byte const*>(buffer.data());
+    auto const loaded = deserialize<L, TagEncoding::varint>(varintIn, varintOut);
+    REQUIRE(loaded);
+    REQUIRE(loaded->index() == 130U);
+    REQUIRE(varintIn == varintOut);
+    // 200 does not name an alternative and no index of L needs 3 bytes
+    auto const* invalid = static_cast<std::byte const*>(buffer.data());
+    buffer[0] = std::byte{0xC8};
+    REQUIRE_FALSE(deserialize<L, TagEncoding::varint>(invalid, varintOut));
+    buffer[1] = std::byte{0x80};
+    REQUIRE_FALSE(deserialize<L, TagEncoding::varint>(invalid, varintOut));
+    REQUIRE(invalid == buffer.data());
+  }
+}
+
+TEST_CASE("VahBinaryRangeSerialization") {
+  using namespace csari::vah;
+  using V = std::variant<std::uint32_t, char, double>;
+  auto const dataVector =
+      std::vector<V>{std::uint32_t{42U}, 'a', 'b', 2.5, std::uint32_t{7U}};
+  auto buffer = std::array<std::byte, 64>{};
+  auto* out = buffer.data();
+  REQUIRE(serializedRangeSize(dataVector.begin(), dataVector.end()) ==
+          16 + 5 + 4 + 1 + 1 + 8 + 4);
+  REQUIRE(serializeRange(dataVector, out, buffer.data() + buffer.size()));
+  REQUIRE(out - buffer.data() == 16 + 5 + 4 + 1 + 1 + 8 + 4);
+  // Tags are stored together ahead of the payload
+  REQUIRE(buffer[16] == std::byte{0});
+  REQUIRE(buffer[17] == std::byte{1});
+  REQUIRE(buffer[19] == std::byte{2});
+
+  auto dataVectorLoaded = std::vector<V>{};
+  auto const* in = static_cast<std::byte const*>(buffer.data());
+  REQUIRE(deserializeRange<V>(in, out, std::back_inserter(dataVectorLoaded)));
+  REQUIRE(in == out);
+  REQUIRE(dataVectorLoaded == dataVector);
+
+  SECTION("Rejects truncated blocks") {
+    auto const* truncated = static_cast<std::byte const*>(buffer.data());
+    auto loaded = std::vector<V>{};
+    REQUIRE_FALSE(
+        deserializeRange<V>(truncated, out - 1, std::back_inserter(loaded)));
+    REQUIRE(truncated == buffer.data());
+    REQUIRE(loaded.empty());
+    auto* small = buffer.data();
+    REQUIRE_FALSE(serializeRange(dataVector, small, buffer.data() + 16));
+    REQUIRE(small == buffer.data());
+  }
+  SECTION("Rejects unknown indices") {
+    buffer[18] = std::byte{3};
+    auto const* unknown = static_cast<std::byte const*>(buffer.data());
+    auto loaded = std::vector<V>{};
+    REQUIRE_FALSE(deserializeRange<V>(unknown, out, std::back_inserter(loaded)));
+    REQUIRE(loaded.empty());
+  }
+  SECTION("Rejects blocks of another variant") {
+    using Reordered = std::variant<char, std::uint32_t, double>;
+    STATIC_REQUIRE(VariantFingerprint<V> != VariantFingerprint<Reordered>);
+    auto const* other = static_cast<std::byte const*>(buffer.data());
+    auto loaded = std::vector<Reordered>{};
+    REQUIRE_FALSE(
+        deserializeRange<Reordered>(other, out, std::back_inserter(loaded)));
+    REQUIRE(other == buffer.data());
+  }
+}
+
+TEST_CASE("VahColumnarSerialization") {
+  using namespace csari::vah;
+  using V = std::variant<std::uint32_t, char, double>;
+  auto const dataVector =
+      std::vector<V>{std::uint32_t{42U}, 'a', 2.5, 'b', std::uint32_t{7U}};
+  auto buffer = std::array<std::byte, 128>{};
+  auto* out = buffer.data();
+  REQUIRE(serializeColumns(dataVector, out, buffer.data() + buffer.size()));
+  REQUIRE(out - buffer.data() ==
+          serializedColumnsSize(dataVector.begin(), dataVector.end()));
+
+  auto const* in = static_cast<std::byte const*>(buffer.data());
+  auto chars = std::string{};
+  REQUIRE(deserializeColumn<V, char>(in, out, std::back_inserter(chars)));
+  REQUIRE(chars == "ab");
+  REQUIRE(in == out);
+  in = buffer.data();
+  auto numbers = std::vector<std::uint32_t>{};
+  REQUIRE(deserializeColumn<V, 0>(in, out, std::back_inserter(numbers)));
+  REQUIRE(numbers == std::vector<std::uint32_t>{42U, 7U});
+
+  in = buffer.data();
+  auto dataVectorLoaded = std::vector<V>{};
+  REQUIRE(deserializeColumns<V>(in, out, std::back_inserter(dataVectorLoaded)));
+  REQUIRE(in == out);
+  REQUIRE(dataVectorLoaded == dataVector);
+
+  SECTION("Rejects truncated blocks") {
+    auto const* truncated = static_cast<std::byte const*>(buffer.data());
+    REQUIRE_FALSE(
+        deserializeColumn<V, char>(truncated, out - 1, std::back_inserter(chars)));
+    REQUIRE_FALSE(deserializeColumns<V>(truncated, out - 1,
+                                        std::back_inserter(dataVectorLoaded)));
+    REQUIRE(truncated == buffer.data());
+  }
+  SECTION("Rejects tags that disagree with the columns") {
+    // The first tag claims a char, leaving the uint32_t column too long
+    auto const tags = sizeof(std::uint64_t) * 6;
+    buffer[tags] = std::byte{1};
+    auto const* mismatched = static_cast<std::byte const*>(buffer.data());
+    auto loaded = std::vector<V>{};
+    REQUIRE_FALSE(
+        deserializeColumns<V>(mismatched, out, std::back_inserter(loaded)));
+    REQUIRE(loaded.empty());
+  }
+}
+
+TEST_CASE("VahStreamView") {
+  using namespace csari::vah;
+  using V = std::variant<std::uint32_t, char, double>;
+  auto const dataVector = std::vector<V>{std::uint32_t{42U}, 'a', 2.5, 'b'};
+  auto buffer = std::array<std::byte, 64>{};
+  auto* out = buffer.data();
+  for (auto const& var : dataVector) {
+    REQUIRE(serialize(var, out, buffer.data() + buffer.size()));
+  }
+  // Unaligned alternatives are read through a copy
+  auto const view = stream_view<V>{buffer.data(), out};
+  auto sum = 0.0;
+  auto chars = std::string{};
+  REQUIRE(view.for_each([&sum, &chars](auto const& val) {
+    if constexpr (std::is_same_v<std::decay_t<decltype(val)>, char>) {
+      chars += val;
+    } else {
+      sum += val;
+    }
+  }));
+  REQUIRE(sum == 44.5);
+  REQUIRE(chars == "ab");
+
+  auto dataVectorLoaded = std::vector<V>{};
+  for (auto const& element : view) {
+    dataVectorLoaded.push_back(element.value());
+  }
+  REQUIRE(dataVectorLoaded == dataVector);
+
+  SECTION("Stops at a truncated element") {
+    auto const truncated = stream_view<V>{buffer.data(), out - 1};
+    REQUIRE(std::distance(truncated.begin(), truncated.end()) == 3);
+    REQUIRE_FALSE(truncated.for_each([](auto const&) {}));
+  }
+  SECTION("Empty view") {
+    auto const empty = stream_view<V>{};
+    REQUIRE(empty.begin() == empty.end());
+    REQUIRE(empty.for_each([](auto const&) {}));
+  }
+}
+
+TEST_CASE("VahStreamIndex") {
+  using namespace csari::vah;
+  using V = std::variant<std::uint32_t, char, double>;
+  auto dataVector = std::vector<V>{};
+  for (auto k = 0; k < 10; ++k) {
+    dataVector.push_back(k % 3 == 0 ? V{static_cast<double>(k)} : V{'a'});
+  }
+  auto buffer = std::array<std::byte, 256>{};
+  auto* out = buffer.data();
+  for (auto const& var : dataVector) {
+    REQUIRE(serialize(var, out, buffer.data() + buffer.size()));
+  }
+  auto const* const streamLast = out;
+  REQUIRE(appendStreamIndex<V>(buffer.data(), out,
+                               buffer.data() + buffer.size(), 4));
+  REQUIRE(out - streamLast == (3 + 3 + 3) * 8);
+
+  auto const index = stream_index<V>::read(buffer.data(), out);
+  REQUIRE(index);
+  REQUIRE(index->size() == 10U);
+  REQUIRE(index->count_of<double>() == 4U);
+  REQUIRE(index->count_of<char>() == 6U);
+  REQUIRE(index->count_of(0) == 0U);
+  REQUIRE(index->stream().end() == stream_view<V>{buffer.data(), streamLast}.end());
+  for (auto k = std::size_t{}; k < dataVector.size(); ++k) {
+    REQUIRE(index->seek(k)->value() == dataVector[k]);
+  }
+  REQUIRE(index->chunks() == 3U);
+  auto dataVectorLoaded = std::vector<V>{};
+  for (auto j = std::size_t{}; j < index->chunks(); ++j) {
+    for (auto const& element : index->chunk(j)) {
+      dataVectorLoaded.push_back(element.value());
+    }
+  }
+  REQUIRE(dataVectorLoaded == dataVector);
+  for (auto const nThreads : {1U, 2U, 8U}) {
+    auto parallelLoaded = std::vector<V>{};
+    REQUIRE(deserializeParallel(*index, parallelLoaded, nThreads));
+    REQUIRE(parallelLoaded == dataVector);
+  }
+
+  SECTION("Rejects a missing or damaged footer") {
+    REQUIRE_FALSE(stream_index<V>::read(buffer.data(), streamLast));
+    buffer[static_cast<std::size_t>(streamLast - buffer.data()) + 8] =
+        std::byte{0xFF};
+    REQUIRE_FALSE(stream_index<V>::read(buffer.data(), out));
+    // Second chunk starting one element early, the first holds too few
+    auto const offset = std::uint64_t{9 + 2 + 2};
+    std::memcpy(buffer.data() + (streamLast - buffer.data()) + 8, &offset,
+                sizeof(offset));
+    auto const shifted = stream_index<V>::read(buffer.data(), out);
+    REQUIRE(shifted);
+    auto parallelLoaded = std::vector<V>{};
+    REQUIRE_FALSE(deserializeParallel(*shifted, parallelLoaded, 2U));
+  }
+  SECTION("Rejects a count the stream has no room for") {
+    // One char after a 2 byte stream, footer claims 2^31 elements
+    auto forged = std::array<std::byte, 2 + (1 + 3 + 3) * 8>{};
+    auto* forgedOut = forged.data();
+    REQUIRE(serialize(V{'a'}, forgedOut, forged.data() + forged.size()));
+    auto const huge = std::uint64_t{1} << 31U;
+    std::uint64_t const footer[] = {0U,   0U,   huge, 0U,
+                                    huge, huge, VariantFingerprint<V>};
+    std::memcpy(forgedOut, footer, sizeof(footer));
+    REQUIRE_FALSE(
+        stream_index<V>::read(forged.data(), forged.data() + forged.size()));
+    // Last chunk moved to the final byte, too short for its 2 elements
+    auto const lastOffset = std::uint64_t{47};
+    std::memcpy(buffer.data() + (streamLast - buffer.data()) + 16, &lastOffset,
+                sizeof(lastOffset));
+    REQUIRE_FALSE(stream_index<V>::read(buffer.data(), out));
+  }
+}
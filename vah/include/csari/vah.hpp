@@ -1,6 +1,21 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <variant>
+namespace csari::vah {
+// Strategy used to turn a runtime index into a compile time alternative
+enum class Dispatch {
+  // One indirect call through a constexpr table of per-alternative thunks
+  table,
+  // Compare the index against every alternative in turn
+  expander
+};
+}  // namespace csari::vah
 namespace csari::vah::vahinternal {
 using Num = std::size_t;
 using std::forward;
@@ -9,6 +24,8 @@ using std::in_place_index;
 using std::index_sequence;
 using std::is_same_v;
 using std::make_index_sequence;
+using std::nullopt;
+using std::optional;
 using std::variant_size_v;
 template <Num idx, class T>
 using variant_t = std::variant_alternative_t<idx, T>;
@@ -16,6 +33,14 @@ template <Num N>
 struct num {
   static constexpr Num value = N;
 };
+// Smallest unsigned type able to hold every index below N
+template <Num N>
+using SmallestIndex = std::conditional_t<
+    (N <= 0x100U), std::uint8_t,
+    std::conditional_t<(N <= 0x10000U), std::uint16_t, std::uint32_t>>;
+// T is exactly one of Ts
+template <class T, class... Ts>
+constexpr auto isAlternative = ((is_same_v<T, Ts> + ...) == 1);
 template <class F, Num... Is>
 constexpr void forConstexprWithExpander(F func, index_sequence<Is...>) {
   using expander = int[];
@@ -25,104 +50,410 @@ template <Num N, class F>
 constexpr void forConstexprWithExpander(F func) {
   forConstexprWithExpander(func, make_index_sequence<N>());
 }
-template <Num targetIndex, Num index, class V, class... Ts>
-constexpr auto constructVariantFromIndexConstexprRecurse(Ts&&... params) -> V {
-  if constexpr (index == targetIndex) {
-    return V{in_place_index<index>, forward<Ts>(params)...};
+template <class R, class F, class Seq>
+struct JumpTable;
+template <class R, class F, Num... Is>
+struct JumpTable<R, F, index_sequence<Is...>> {
+  template <Num I>
+  static constexpr auto thunk(F& func) -> R {
+    return func(num<I>{});
   }
-  if constexpr (index + 1 < vahinternal::variant_size_v<V>) {
-    return constructVariantFromIndexConstexprRecurse<targetIndex, index + 1, V>(
-        forward<Ts>(params)...);
-  }
-  // Index out of bounds
+  static constexpr R (*table[])(F&) = {&thunk<Is>...};
+};
+// index must be less than N
+template <Num N, class F>
+constexpr decltype(auto) forIndexWithJumpTable(Num const index, F func) {
+  using R = decltype(func(num<0>{}));
+  return JumpTable<R, F, make_index_sequence<N>>::table[index](func);
+}
+template <Num targetIndex, class V, class... Ts>
+constexpr auto constructVariantFromIndexConstexprImplementation(Ts&&... params)
+    -> V {
+  // Index out of bounds constructs the last alternative
+  constexpr auto index = targetIndex < variant_size_v<V>
+                             ? targetIndex
+                             : variant_size_v<V> - 1;
   return V{in_place_index<index>, forward<Ts>(params)...};
 }
-template <Num index, class V, class... Ts>
-auto constructVariantFromIndexRuntimeRecurse(Num const targetIndex,
-                                             Ts&&... params) -> V {
-  if (index == targetIndex) {
-    return V{in_place_index<index>, forward<Ts>(params)...};
-  }
-  if constexpr (index + 1 < variant_size_v<V>) {
-    return constructVariantFromIndexRuntimeRecurse<index + 1, V>(
-        targetIndex, forward<Ts>(params)...);
-  } else {
+template <class V, class... Ts>
+auto constructVariantFromIndexRuntimeTable(Num const targetIndex,
+                                           Ts&&... params) -> V {
+  // Index out of bounds constructs the first alternative
+  auto const index = targetIndex < variant_size_v<V> ? targetIndex : Num{0};
+  return forIndexWithJumpTable<variant_size_v<V>>(index, [&](auto i) -> V {
+    return V{in_place_index<i.value>, forward<Ts>(params)...};
+  });
+}
+
+// Selects the alternative once, builds it and hands it to f
+template <class V, class F, class... Ts>
+auto constructAndPerformOnDataTable(Num const targetIndex, F& f,
+                                    Ts&&... params) -> V {
+  if (targetIndex >= variant_size_v<V>) {
+    // Index out of bounds constructs the first alternative without calling f
     return V{in_place_index<0>, forward<Ts>(params)...};
   }
+  return forIndexWithJumpTable<variant_size_v<V>>(
+      targetIndex, [&](auto i) -> V {
+        auto v = V{in_place_index<i.value>, forward<Ts>(params)...};
+        f(get<i.value>(v));
+        return v;
+      });
+}
+
+// Rejects out of range indices with a single comparison before dispatching
+template <class V, class F, class... Ts>
+auto tryConstructAndPerformOnDataTable(Num const targetIndex, F& f,
+                                       Ts&&... params) -> optional<V> {
+  if (targetIndex >= variant_size_v<V>) {
+    return nullopt;
+  }
+  return forIndexWithJumpTable<variant_size_v<V>>(
+      targetIndex, [&](auto i) -> optional<V> {
+        auto v = optional<V>{std::in_place, in_place_index<i.value>,
+                             forward<Ts>(params)...};
+        f(get<i.value>(*v));
+        return v;
+      });
 }
 
-template <class VariantType, class T, Num index = 0>
-constexpr auto variantIndexImplementation() -> Num {
-  if constexpr (index == variant_size_v<VariantType>) {
-    return index;
-  } else if constexpr (is_same_v<variant_t<index, VariantType>, T>) {
-    return index;
+// Reuses the storage of variantData, no temporary V is created
+template <class V, class F, class... Ts>
+void emplaceAndPerformOnDataTable(V& variantData, Num const targetIndex, F& f,
+                                  Ts&&... params) {
+  if (targetIndex >= variant_size_v<V>) {
+    // Index out of bounds emplaces the first alternative without calling f
+    variantData.template emplace<0>(forward<Ts>(params)...);
+    return;
+  }
+  forIndexWithJumpTable<variant_size_v<V>>(targetIndex, [&](auto i) {
+    f(variantData.template emplace<i.value>(forward<Ts>(params)...));
+  });
+}
+
+// Alternatives of a variant as a pack, without recursing through
+// variant_alternative
+template <class... Ts>
+struct TypeList {};
+template <class V, class Seq = make_index_sequence<variant_size_v<V>>>
+struct AlternativesOf;
+template <class V, Num... Is>
+struct AlternativesOf<V, index_sequence<Is...>> {
+  using type = TypeList<variant_t<Is, V>...>;
+};
+template <class... Ts, Num... Is>
+struct AlternativesOf<std::variant<Ts...>, index_sequence<Is...>> {
+  using type = TypeList<Ts...>;
+};
+template <class T, Num index, class... Ts>
+constexpr auto variantIndexImplementation(TypeList<Ts...>) -> Num {
+  constexpr bool matches[] = {is_same_v<Ts, T>..., false};
+  for (auto i = index; i < sizeof...(Ts); ++i) {
+    if (matches[i]) {
+      return i;
+    }
+  }
+  return sizeof...(Ts);
+}
+template <class T, class... Ts>
+constexpr auto typeCount(TypeList<Ts...>) -> Num {
+  return (Num{0} + ... + Num{is_same_v<Ts, T>});
+}
+// Every alternative paired with its index, built once per variant. Looking a
+// type up is a derived to base conversion instead of a walk over the
+// alternatives.
+template <class T, Num I>
+struct IndexedAlternative {};
+template <class List, class Seq>
+struct IndexedAlternatives;
+template <class... Ts, Num... Is>
+struct IndexedAlternatives<TypeList<Ts...>, index_sequence<Is...>>
+    : IndexedAlternative<Ts, Is>... {};
+template <class V>
+using IndexedAlternativesOf =
+    IndexedAlternatives<typename AlternativesOf<V>::type,
+                        make_index_sequence<variant_size_v<V>>>;
+// Deduction fails when T is missing or appears more than once
+template <class T, Num I>
+constexpr auto uniqueIndexOf(IndexedAlternative<T, I> const*) -> Num {
+  return I;
+}
+template <class T>
+constexpr auto uniqueIndexOf(void const*) -> Num {
+  return std::variant_npos;
+}
+template <class V, class T, Num index>
+constexpr auto variantIndexOf() -> Num {
+  if constexpr (index == std::variant_npos) {
+    constexpr auto unique =
+        uniqueIndexOf<T>(static_cast<IndexedAlternativesOf<V> const*>(nullptr));
+    if constexpr (unique == std::variant_npos) {
+      constexpr auto count = typeCount<T>(typename AlternativesOf<V>::type{});
+      static_assert(count != 0, "T is not an alternative of the variant");
+      static_assert(count < 2,
+                    "T appears more than once in the variant, pass the index "
+                    "to start searching from");
+    }
+    return unique;
   } else {
-    return variantIndexImplementation<VariantType, T, index + 1>();
+    return variantIndexImplementation<T, index>(
+        typename AlternativesOf<V>::type{});
   }
 }
 
-template <class V, class F>
-constexpr void performOnData(V& variantData, vahinternal::Num const index,
-                             F f) {
-  vahinternal::forConstexprWithExpander<vahinternal::variant_size_v<V>>(
-      [ index, &variantData, &f ](auto i) constexpr {
-        if (i.value == index) {
-          f(vahinternal::get<i.value>(variantData));
+// V may be const qualified
+template <Dispatch strategy, class V, class F>
+constexpr void performOnDataWith(V& variantData, Num const index, F& f) {
+  if constexpr (strategy == Dispatch::table) {
+    // valueless_by_exception variants report variant_npos
+    if (index < variant_size_v<V>) {
+      forIndexWithJumpTable<variant_size_v<V>>(
+          index, [&variantData, &f](auto i) constexpr {
+            f(get<i.value>(variantData));
+          });
+    }
+  } else {
+    forConstexprWithExpander<variant_size_v<V>>(
+        [ index, &variantData, &f ](auto i) constexpr {
+          if (i.value == index) {
+            f(get<i.value>(variantData));
+          }
+        });
+  }
+}
+// Placeholder for performOnDataR to take the result type from f
+struct DeducedResult;
+template <class R, class F, class... Vs>
+struct PerformResultImplementation {
+  using type = R;
+};
+template <class F, class... Vs>
+struct PerformResultImplementation<DeducedResult, F, Vs...> {
+  using type = decltype(std::declval<F&>()(get<0>(std::declval<Vs&>())...));
+};
+template <class R, class V, class F>
+struct PerformResultOf : PerformResultImplementation<R, F, V> {};
+template <class R, class... Vs, class F>
+struct PerformResultOf<R, std::tuple<Vs...>, F>
+    : PerformResultImplementation<R, F, Vs...> {};
+// V is either one variant or a tuple of the variants visited together
+template <class R, class V, class F>
+using PerformResult = typename PerformResultOf<R, V, F>::type;
+// V may be const qualified
+template <class R, class V, class F>
+constexpr auto performOnDataReturning(V& variantData, F& f)
+    -> PerformResult<R, V, F> {
+  using Result = PerformResult<R, V, F>;
+  auto const index = variantData.index();
+  if (index >= variant_size_v<V>) {
+    throw std::bad_variant_access{};
+  }
+  return forIndexWithJumpTable<variant_size_v<V>>(
+      index, [&variantData, &f](auto i) constexpr -> Result {
+        if constexpr (is_same_v<R, DeducedResult>) {
+          static_assert(
+              is_same_v<decltype(f(get<i.value>(variantData))), Result>,
+              "f must return the same type for every alternative");
         }
+        return f(get<i.value>(variantData));
       });
 }
-template <class V, class F>
+// Index of alternative k for the flattened index of several variants, the
+// last variant varies fastest
+template <Num flatIndex, Num k, class... Vs>
+constexpr auto unflattenIndex() -> Num {
+  constexpr Num sizes[] = {variant_size_v<Vs>...};
+  auto stride = Num{1};
+  for (auto j = k + 1; j < sizeof...(Vs); ++j) {
+    stride *= sizes[j];
+  }
+  return flatIndex / stride % sizes[k];
+}
+// R is the requested result type, Result the one returned, the result of f is
+// discarded when it is void
+template <class R, class Result, Num flatIndex, class F, class... Vs,
+          Num... Ks>
+constexpr auto performOnFlatIndex(F& f, index_sequence<Ks...>,
+                                  Vs&... variantData) -> Result {
+  if constexpr (is_same_v<R, DeducedResult>) {
+    static_assert(
+        is_same_v<decltype(f(get<unflattenIndex<flatIndex, Ks, Vs...>()>(
+                      variantData)...)),
+                  Result>,
+        "f must return the same type for every combination of alternatives");
+  }
+  if constexpr (std::is_void_v<Result>) {
+    (void)f(get<unflattenIndex<flatIndex, Ks, Vs...>()>(variantData)...);
+  } else {
+    return f(get<unflattenIndex<flatIndex, Ks, Vs...>()>(variantData)...);
+  }
+}
+// Vs may be const qualified
+template <class R, class F, class... Vs>
+constexpr auto performOnDataMulti(F& f, Vs&... variantData)
+    -> PerformResult<R, std::tuple<Vs...>, F> {
+  using Result = PerformResult<R, std::tuple<Vs...>, F>;
+  auto constexpr nCombinations = (Num{1} * ... * variant_size_v<Vs>);
+  auto flatIndex = Num{};
+  ((flatIndex = flatIndex * variant_size_v<Vs> + variantData.index()), ...);
+  if (((variantData.index() >= variant_size_v<Vs>) || ...)) {
+    if constexpr (std::is_void_v<Result>) {
+      return;
+    } else {
+      throw std::bad_variant_access{};
+    }
+  }
+  return forIndexWithJumpTable<nCombinations>(
+      flatIndex, [&](auto i) constexpr -> Result {
+        return performOnFlatIndex<R, Result, i.value>(
+            f, make_index_sequence<sizeof...(Vs)>{}, variantData...);
+      });
+}
+// Dispatches once per run of equal index() and visits the run with a loop
+// specialized for that alternative
+template <class It, class F>
+constexpr void performOnRangeRuns(It first, It const last, F& f) {
+  using V = std::remove_reference_t<decltype(*first)>;
+  while (first != last) {
+    auto const index = first->index();
+    if (index >= variant_size_v<V>) {
+      // valueless_by_exception
+      ++first;
+      continue;
+    }
+    first = forIndexWithJumpTable<variant_size_v<V>>(
+        index, [&first, &last, &f](auto i) constexpr -> It {
+          auto it = first;
+          do {
+            f(get<i.value>(*it));
+            ++it;
+          } while (it != last && it->index() == i.value);
+          return it;
+        });
+  }
+}
+template <Dispatch strategy = Dispatch::table, class V, class F>
+constexpr void performOnData(V& variantData, vahinternal::Num const index,
+                             F f) {
+  performOnDataWith<strategy>(variantData, index, f);
+}
+template <Dispatch strategy = Dispatch::table, class V, class F>
 constexpr void performOnData(V const& variantData, vahinternal::Num const index,
                              F f) {
-  vahinternal::forConstexprWithExpander<vahinternal::variant_size_v<V>>(
-      [ index, &variantData, &f ](auto const i) constexpr {
-        if (i.value == index) {
-          f(vahinternal::get<i.value>(variantData));
-        }
-      });
+  performOnDataWith<strategy>(variantData, index, f);
 }
 }  // namespace csari::vah::vahinternal
 namespace csari::vah {
 template <class V, class... Ts>
 auto constructVariantFromIndexRuntime(vahinternal::Num const targetIndex,
                                       Ts&&... params) -> V {
-  return vahinternal::constructVariantFromIndexRuntimeRecurse<0, V>(
+  return vahinternal::constructVariantFromIndexRuntimeTable<V>(
       targetIndex, vahinternal::forward<Ts>(params)...);
 }
 template <vahinternal::Num targetIndex, class V, class... Ts>
 constexpr auto constructVariantFromIndexConstexpr(Ts&&... params) -> V {
-  return vahinternal::constructVariantFromIndexConstexprRecurse<targetIndex, 0,
-                                                                V>(
-      vahinternal::forward<Ts>(params)...);
+  return vahinternal::constructVariantFromIndexConstexprImplementation<
+      targetIndex, V>(vahinternal::forward<Ts>(params)...);
 }
 template <class V, class F, class... Ts>
 auto constructAndPerformOnData(vahinternal::Num const index, F f, Ts&&... args)
     -> V {
-  auto v = constructVariantFromIndexRuntime<V>(
-      index, vahinternal::forward<Ts>(args)...);
-  vahinternal::forConstexprWithExpander<vahinternal::variant_size_v<V>>([&](
-      auto i) constexpr {
-    if (i.value == index) {
-      f(vahinternal::get<i.value>(v));
-    }
-  });
-  return v;
+  return vahinternal::constructAndPerformOnDataTable<V>(
+      index, f, vahinternal::forward<Ts>(args)...);
+}
+
+// Returns nullopt instead of falling back to the first alternative when
+// targetIndex is out of range
+template <class V, class... Ts>
+auto tryConstructVariantFromIndexRuntime(vahinternal::Num const targetIndex,
+                                         Ts&&... params)
+    -> vahinternal::optional<V> {
+  auto const fNone = [](auto&) {};
+  return vahinternal::tryConstructAndPerformOnDataTable<V>(
+      targetIndex, fNone, vahinternal::forward<Ts>(params)...);
+}
+template <class V, class F, class... Ts>
+auto tryConstructAndPerformOnData(vahinternal::Num const index, F f,
+                                  Ts&&... args) -> vahinternal::optional<V> {
+  return vahinternal::tryConstructAndPerformOnDataTable<V>(
+      index, f, vahinternal::forward<Ts>(args)...);
+}
+
+template <class V, class... Ts>
+void emplaceFromIndexRuntime(V& variantData, vahinternal::Num const targetIndex,
+                             Ts&&... params) {
+  auto const fNone = [](auto&) {};
+  vahinternal::emplaceAndPerformOnDataTable(
+      variantData, targetIndex, fNone, vahinternal::forward<Ts>(params)...);
+}
+template <class V, class F, class... Ts>
+void emplaceAndPerformOnData(V& variantData, vahinternal::Num const index, F f,
+                             Ts&&... args) {
+  vahinternal::emplaceAndPerformOnDataTable(
+      variantData, index, f, vahinternal::forward<Ts>(args)...);
 }
 
-template <class V, class F>
+template <Dispatch strategy = Dispatch::table, class V, class F>
 constexpr void performOnData(V& variantData, F&& f) {
-  vahinternal::performOnData(variantData, variantData.index(),
-                             vahinternal::forward<F>(f));
+  vahinternal::performOnData<strategy>(variantData, variantData.index(),
+                                       vahinternal::forward<F>(f));
 }
-template <class V, class F>
+template <Dispatch strategy = Dispatch::table, class V, class F>
 constexpr void performOnData(V const& variantData, F&& f) {
-  vahinternal::performOnData(variantData, variantData.index(),
-                             vahinternal::forward<F>(f));
+  vahinternal::performOnData<strategy>(variantData, variantData.index(),
+                                       vahinternal::forward<F>(f));
+}
+
+// Returns the result of f on the active alternative, converted to R. With R
+// omitted every alternative must yield the same type. Throws
+// std::bad_variant_access when variantData is valueless.
+template <class R = vahinternal::DeducedResult, class V, class F>
+constexpr auto performOnDataR(V&& variantData, F&& f)
+    -> vahinternal::PerformResult<R, std::remove_reference_t<V>, F> {
+  return vahinternal::performOnDataReturning<R>(variantData, f);
+}
+
+// Visits the active alternatives of two or more variants with a single
+// indirect call through a table of every combination of alternatives. Does
+// nothing when one of the variants is valueless.
+template <class F, class V1, class V2, class... Vs>
+constexpr void performOnData(F&& f, V1&& variantData1, V2&& variantData2,
+                             Vs&&... variantData) {
+  vahinternal::performOnDataMulti<void>(f, variantData1, variantData2,
+                                        variantData...);
+}
+template <class R = vahinternal::DeducedResult, class F, class V1, class V2,
+          class... Vs>
+constexpr auto performOnDataR(F&& f, V1&& variantData1, V2&& variantData2,
+                              Vs&&... variantData)
+    -> vahinternal::PerformResult<
+        R,
+        std::tuple<std::remove_reference_t<V1>, std::remove_reference_t<V2>,
+                   std::remove_reference_t<Vs>...>,
+        F> {
+  return vahinternal::performOnDataMulti<R>(f, variantData1, variantData2,
+                                            variantData...);
+}
+
+// Same as calling performOnData on every element of [first, last), but the
+// dispatch cost is paid once per run of elements holding the same
+// alternative
+template <class It, class F>
+constexpr void performOnRange(It first, It last, F&& f) {
+  vahinternal::performOnRangeRuns(first, last, f);
+}
+template <class Range, class F>
+constexpr void performOnRange(Range&& range, F&& f) {
+  using std::begin;
+  using std::end;
+  vahinternal::performOnRangeRuns(begin(range), end(range), f);
 }
 
-// Get index from the current variant types
-template <class VariantType, class T, vahinternal::Num index = 0>
+// Get index from the current variant types. T must appear exactly once
+// unless index is given, then the first match at or after index is returned
+// and variant_size_v when there is none.
+template <class VariantType, class T,
+          vahinternal::Num index = std::variant_npos>
 constexpr vahinternal::Num VariantIndex =
-    vahinternal::variantIndexImplementation<VariantType, T, index>();
-}  // namespace csari::vah
\ No newline at end of file
+    vahinternal::variantIndexOf<VariantType, T, index>();
+}  // namespace csari::vah
\ No newline at end of file
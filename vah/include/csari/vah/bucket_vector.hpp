@@ -0,0 +1,116 @@
+#pragma once
+#include <csari/vah.hpp>
+#include <tuple>
+#include <vector>
+namespace csari::vah::vahinternal {
+template <class V, class Seq>
+struct BucketsOf;
+template <class V, Num... Is>
+struct BucketsOf<V, index_sequence<Is...>> {
+  using type = std::tuple<std::vector<variant_t<Is, V>>...>;
+};
+template <class V>
+using Buckets =
+    typename BucketsOf<V, make_index_sequence<variant_size_v<V>>>::type;
+}  // namespace csari::vah::vahinternal
+namespace csari::vah {
+// Stores every alternative of V in its own contiguous vector instead of
+// padding each element to the largest alternative. Elements are grouped by
+// alternative, insertion order is only kept within an alternative.
+template <class V>
+class bucket_vector final {
+ public:
+  using variant_type = V;
+  using size_type = vahinternal::Num;
+
+  template <size_type I>
+  auto bucket() -> std::vector<vahinternal::variant_t<I, V>>& {
+    return std::get<I>(buckets);
+  }
+  template <size_type I>
+  auto bucket() const -> std::vector<vahinternal::variant_t<I, V>> const& {
+    return std::get<I>(buckets);
+  }
+  template <class T>
+  auto bucket() -> std::vector<T>& {
+    return bucket<VariantIndex<V, T>>();
+  }
+  template <class T>
+  auto bucket() const -> std::vector<T> const& {
+    return bucket<VariantIndex<V, T>>();
+  }
+
+  void push_back(V const& variantData) {
+    performOnDataIndexed(variantData, [this](auto i, auto const& val) {
+      bucket<i.value>().push_back(val);
+    });
+  }
+  void push_back(V&& variantData) {
+    performOnDataIndexed(variantData, [this](auto i, auto& val) {
+      bucket<i.value>().push_back(std::move(val));
+    });
+  }
+  template <class T, class... Ts>
+  auto emplace_back(Ts&&... params) -> T& {
+    return bucket<T>().emplace_back(vahinternal::forward<Ts>(params)...);
+  }
+
+  // Calls f on every element, one tight loop per alternative
+  template <class F>
+  void for_each(F&& f) {
+    forEachBucket([&f](auto& vec) {
+      for (auto& val : vec) {
+        f(val);
+      }
+    });
+  }
+  template <class F>
+  void for_each(F&& f) const {
+    forEachBucket([&f](auto const& vec) {
+      for (auto const& val : vec) {
+        f(val);
+      }
+    });
+  }
+  // Calls f once per alternative with the whole bucket
+  template <class F>
+  void for_each_bucket(F&& f) {
+    forEachBucket(f);
+  }
+  template <class F>
+  void for_each_bucket(F&& f) const {
+    forEachBucket(f);
+  }
+
+  [[nodiscard]] auto size() const -> size_type {
+    auto total = size_type{};
+    forEachBucket([&total](auto const& vec) { total += vec.size(); });
+    return total;
+  }
+  [[nodiscard]] auto empty() const -> bool { return size() == 0U; }
+  void clear() {
+    forEachBucket([](auto& vec) { vec.clear(); });
+  }
+
+ private:
+  template <class U, class F>
+  static void performOnDataIndexed(U& variantData, F f) {
+    if (variantData.valueless_by_exception()) {
+      throw std::bad_variant_access{};
+    }
+    vahinternal::forIndexWithJumpTable<vahinternal::variant_size_v<V>>(
+        variantData.index(),
+        [&variantData, &f](auto i) { f(i, std::get<i.value>(variantData)); });
+  }
+  template <class F>
+  void forEachBucket(F&& f) {
+    std::apply([&f](auto&... vec) { (f(vec), ...); }, buckets);
+  }
+  template <class F>
+  void forEachBucket(F&& f) const {
+    std::apply([&f](auto const&... vec) { (f(vec), ...); }, buckets);
+  }
+
+  vahinternal::Buckets<V> buckets;
+};
+}  // namespace csari::vah
@@ -0,0 +1,145 @@
+#pragma once
+#include <csari/vah.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <variant>
+namespace csari::vah {
+template <class... Ts>
+class compact_variant;
+}  // namespace csari::vah
+namespace std {
+template <class... Ts>
+struct variant_size<csari::vah::compact_variant<Ts...>>
+    : integral_constant<size_t, sizeof...(Ts)> {};
+template <size_t I, class... Ts>
+struct variant_alternative<I, csari::vah::compact_variant<Ts...>>
+    : variant_alternative<I, variant<Ts...>> {};
+}  // namespace std
+namespace csari::vah {
+// Variant of trivially copyable alternatives that stores its index in the
+// smallest unsigned type able to hold it, right after the bytes of the
+// largest alternative. It is trivially copyable itself and never valueless.
+// Works with every vah entry point taking a variant.
+template <class... Ts>
+class compact_variant final {
+  static_assert(sizeof...(Ts) > 0U, "compact_variant needs an alternative");
+  static_assert((std::is_trivially_copyable_v<Ts> && ...),
+                "compact_variant requires trivially copyable alternatives");
+
+ public:
+  using tag_type = vahinternal::SmallestIndex<sizeof...(Ts)>;
+
+  compact_variant() : compact_variant{std::in_place_index<0>} {}
+  template <vahinternal::Num I, class... Args>
+  explicit compact_variant(std::in_place_index_t<I> /*unused*/,
+                           Args&&... args) {
+    emplace<I>(vahinternal::forward<Args>(args)...);
+  }
+  template <class T, class... Args,
+            class = std::enable_if_t<vahinternal::isAlternative<T, Ts...>>>
+  explicit compact_variant(std::in_place_type_t<T> /*unused*/, Args&&... args)
+      : compact_variant{std::in_place_index<VariantIndex<compact_variant, T>>,
+                        vahinternal::forward<Args>(args)...} {}
+  // Only exact alternatives convert, there is no overload resolution
+  template <class T, class U = std::remove_cv_t<std::remove_reference_t<T>>,
+            class = std::enable_if_t<vahinternal::isAlternative<U, Ts...>>>
+  compact_variant(T&& val)  // NOLINT(google-explicit-constructor)
+      : compact_variant{std::in_place_type<U>, vahinternal::forward<T>(val)} {
+  }
+
+  [[nodiscard]] auto index() const -> vahinternal::Num { return tag; }
+  [[nodiscard]] constexpr auto valueless_by_exception() const -> bool {
+    return false;
+  }
+
+  template <vahinternal::Num I, class... Args>
+  auto emplace(Args&&... args) -> vahinternal::variant_t<I, compact_variant>& {
+    using T = vahinternal::variant_t<I, compact_variant>;
+    // Built aside first, a throwing constructor leaves the old value intact
+    auto val = T(vahinternal::forward<Args>(args)...);
+    auto* const constructed = ::new (static_cast<void*>(storage)) T(val);
+    tag = static_cast<tag_type>(I);
+    return *constructed;
+  }
+  template <class T, class... Args,
+            class = std::enable_if_t<vahinternal::isAlternative<T, Ts...>>>
+  auto emplace(Args&&... args) -> T& {
+    return emplace<VariantIndex<compact_variant, T>>(
+        vahinternal::forward<Args>(args)...);
+  }
+
+  friend auto operator==(compact_variant const& lhs, compact_variant const& rhs)
+      -> bool {
+    if (lhs.index() != rhs.index()) {
+      return false;
+    }
+    return vahinternal::forIndexWithJumpTable<sizeof...(Ts)>(
+        lhs.index(), [&lhs, &rhs](auto i) -> bool {
+          return lhs.template alternative<i.value>() ==
+                 rhs.template alternative<i.value>();
+        });
+  }
+  friend auto operator!=(compact_variant const& lhs, compact_variant const& rhs)
+      -> bool {
+    return !(lhs == rhs);
+  }
+
+  // Unchecked access to alternative I
+  template <vahinternal::Num I>
+  auto alternative() -> vahinternal::variant_t<I, compact_variant>& {
+    return *std::launder(
+        reinterpret_cast<vahinternal::variant_t<I, compact_variant>*>(
+            storage));
+  }
+  template <vahinternal::Num I>
+  auto alternative() const
+      -> vahinternal::variant_t<I, compact_variant> const& {
+    return *std::launder(
+        reinterpret_cast<vahinternal::variant_t<I, compact_variant> const*>(
+            storage));
+  }
+
+ private:
+  alignas(Ts...) std::byte storage[std::max({sizeof(Ts)...})];
+  tag_type tag{};
+};
+
+// Same contract as std::get, throws std::bad_variant_access when alternative
+// I is not active
+template <vahinternal::Num I, class... Ts>
+auto get(compact_variant<Ts...>& variantData)
+    -> vahinternal::variant_t<I, compact_variant<Ts...>>& {
+  if (variantData.index() != I) {
+    throw std::bad_variant_access{};
+  }
+  return variantData.template alternative<I>();
+}
+template <vahinternal::Num I, class... Ts>
+auto get(compact_variant<Ts...> const& variantData)
+    -> vahinternal::variant_t<I, compact_variant<Ts...>> const& {
+  if (variantData.index() != I) {
+    throw std::bad_variant_access{};
+  }
+  return variantData.template alternative<I>();
+}
+template <vahinternal::Num I, class... Ts>
+auto get(compact_variant<Ts...>&& variantData)
+    -> vahinternal::variant_t<I, compact_variant<Ts...>>&& {
+  return std::move(get<I>(variantData));
+}
+template <class T, class... Ts>
+auto get(compact_variant<Ts...>& variantData) -> T& {
+  return get<VariantIndex<compact_variant<Ts...>, T>>(variantData);
+}
+template <class T, class... Ts>
+auto get(compact_variant<Ts...> const& variantData) -> T const& {
+  return get<VariantIndex<compact_variant<Ts...>, T>>(variantData);
+}
+template <class T, class... Ts>
+auto holds_alternative(compact_variant<Ts...> const& variantData) -> bool {
+  return variantData.index() == VariantIndex<compact_variant<Ts...>, T>;
+}
+}  // namespace csari::vah
@@ -0,0 +1,277 @@
+#pragma once
+#include <csari/vah.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+// AVX2 is used outright when the compiler targets it. GCC and Clang on x86
+// otherwise compile an AVX2 kernel next to the SSE2 one and pick it at
+// runtime. Other compilers and targets decide at compile time.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CSARI_VAH_AVX2
+#define CSARI_VAH_TARGET_AVX2
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CSARI_VAH_AVX2
+#define CSARI_VAH_AVX2_DISPATCH
+#define CSARI_VAH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#if !defined(__AVX2__) && (defined(__SSE2__) || defined(_M_X64) || \
+                           (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CSARI_VAH_SSE2
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+namespace csari::vah::vahinternal {
+inline auto popcount64(std::uint64_t bits) -> Num {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<Num>(__builtin_popcountll(bits));
+#else
+  auto count = Num{};
+  for (; bits != 0U; bits &= bits - 1U) {
+    ++count;
+  }
+  return count;
+#endif
+}
+// bits must not be zero
+inline auto countTrailingZeros64(std::uint64_t const bits) -> Num {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<Num>(__builtin_ctzll(bits));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index{};
+  _BitScanForward64(&index, bits);
+  return index;
+#else
+  auto index = Num{};
+  for (; (bits >> index & 1U) == 0U; ++index) {
+  }
+  return index;
+#endif
+}
+#if defined(CSARI_VAH_AVX2)
+// Bit k is set when tags[k] == value, for the 64 one byte tags at tags
+CSARI_VAH_TARGET_AVX2 inline auto matchMask64Avx2(
+    std::uint8_t const* const tags, std::uint8_t const value)
+    -> std::uint64_t {
+  auto const needle = _mm256_set1_epi8(static_cast<char>(value));
+  auto mask = std::uint64_t{};
+  for (auto half = 0U; half < 2U; ++half) {
+    auto const block = _mm256_loadu_si256(
+        reinterpret_cast<__m256i const*>(tags + 32U * half));
+    auto const bits = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+    mask |= std::uint64_t{bits} << (32U * half);
+  }
+  return mask;
+}
+#endif
+// Bit k is set when tags[k] == value, for the 64 tags starting at tags, with
+// the instructions the compiler targets
+template <class Tag>
+auto matchMask64(Tag const* const tags, Tag const value) -> std::uint64_t {
+  auto mask = std::uint64_t{};
+  if constexpr (sizeof(Tag) == 1U) {
+#if defined(__AVX2__)
+    return matchMask64Avx2(reinterpret_cast<std::uint8_t const*>(tags),
+                           static_cast<std::uint8_t>(value));
+#elif defined(CSARI_VAH_SSE2)
+    auto const needle = _mm_set1_epi8(static_cast<char>(value));
+    for (auto quarter = 0U; quarter < 4U; ++quarter) {
+      auto const block = _mm_loadu_si128(
+          reinterpret_cast<__m128i const*>(tags + 16U * quarter));
+      auto const bits = static_cast<std::uint16_t>(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+      mask |= std::uint64_t{bits} << (16U * quarter);
+    }
+    return mask;
+#endif
+  }
+  for (auto k = 0U; k < 64U; ++k) {
+    mask |= std::uint64_t{tags[k] == value} << k;
+  }
+  return mask;
+}
+// Mask of the matches among the last n < 64 tags
+template <class Tag>
+auto matchMaskTail(Tag const* const tags, Num const n, Tag const value)
+    -> std::uint64_t {
+  auto mask = std::uint64_t{};
+  for (auto k = Num{}; k < n; ++k) {
+    mask |= std::uint64_t{tags[k] == value} << k;
+  }
+  return mask;
+}
+// Calls f(offset, mask) for every block of 64 tags in [from, n), the last
+// one may be shorter, until f returns false. Returns false when f did.
+template <class Tag, class F>
+auto scanMatchMasks(Tag const* const tags, Num from, Num const n,
+                    Tag const value, F& f) -> bool {
+  for (; from + 64U <= n; from += 64U) {
+    if (!f(from, matchMask64(tags + from, value))) {
+      return false;
+    }
+  }
+  return from >= n || f(from, matchMaskTail(tags + from, n - from, value));
+}
+#if defined(CSARI_VAH_AVX2_DISPATCH)
+inline auto cpuHasAvx2() -> bool {
+  static auto const hasAvx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return hasAvx2;
+}
+// Same as scanMatchMasks, compiled for AVX2 so that the kernel and f are
+// inlined into the loop
+template <class F>
+CSARI_VAH_TARGET_AVX2 auto scanMatchMasksAvx2(std::uint8_t const* const tags,
+                                              Num from, Num const n,
+                                              std::uint8_t const value, F& f)
+    -> bool {
+  for (; from + 64U <= n; from += 64U) {
+    if (!f(from, matchMask64Avx2(tags + from, value))) {
+      return false;
+    }
+  }
+  return from >= n || f(from, matchMaskTail(tags + from, n - from, value));
+}
+#endif
+// scanMatchMasks for index, taking the AVX2 loop when it was compiled for
+// runtime selection and the CPU has it
+template <class Tag, class F>
+auto scanMatches(Tag const* const tags, Num const from, Num const n,
+                 Num const index, F&& f) -> bool {
+  auto const value = static_cast<Tag>(index);
+  if (value != index) {
+    // No tag of this width can hold index
+    return true;
+  }
+#if defined(CSARI_VAH_AVX2_DISPATCH)
+  if constexpr (sizeof(Tag) == 1U) {
+    if (cpuHasAvx2()) {
+      return scanMatchMasksAvx2(reinterpret_cast<std::uint8_t const*>(tags),
+                                from, n, static_cast<std::uint8_t>(value), f);
+    }
+  }
+#endif
+  return scanMatchMasks(tags, from, n, value, f);
+}
+// Calls f(offset, mask) for every block of 64 tags, the last one may be
+// shorter
+template <class Tag, class F>
+void forEachMatchMask(Tag const* const tags, Num const n, Num const index,
+                      F&& f) {
+  scanMatches(tags, Num{}, n, index,
+              [&f](Num const offset, std::uint64_t const mask) {
+                f(offset, mask);
+                return true;
+              });
+}
+// Number of k < n with tags[k] == index
+template <class Tag>
+auto countMatches(Tag const* const tags, Num const n, Num const index) -> Num {
+  auto count = Num{};
+  forEachMatchMask(tags, n, index, [&count](auto, std::uint64_t const mask) {
+    count += popcount64(mask);
+  });
+  return count;
+}
+// First k in [from, n) with tags[k] == index, n when there is none. Stops at
+// the first block of 64 tags holding a match.
+template <class Tag>
+auto findMatch(Tag const* const tags, Num const from, Num const n,
+               Num const index) -> Num {
+  auto found = n;
+  scanMatches(tags, from, n, index,
+              [&found](Num const offset, std::uint64_t const mask) {
+                if (mask == 0U) {
+                  return true;
+                }
+                found = offset + countTrailingZeros64(mask);
+                return false;
+              });
+  return found;
+}
+#undef CSARI_VAH_AVX2
+#undef CSARI_VAH_AVX2_DISPATCH
+#undef CSARI_VAH_TARGET_AVX2
+#undef CSARI_VAH_SSE2
+}  // namespace csari::vah::vahinternal
+namespace csari::vah {
+// Kernels over arrays of variant indices, such as
+// split_variant_vector::indices() or the tag column written by
+// serializeColumns. One byte indices are compared 32 at a time with AVX2
+// when the CPU has it, chosen at runtime on GCC and Clang for x86, and 16 at
+// a time with SSE2 otherwise. Wider indices and other targets use the scalar
+// loop.
+
+// Number of elements holding each alternative of V, indices past the last
+// alternative are not counted
+template <class V, class Tag>
+auto indexHistogram(Tag const* const tags, vahinternal::Num const n)
+    -> std::array<vahinternal::Num, vahinternal::variant_size_v<V>> {
+  static_assert(std::is_unsigned_v<Tag>, "Tag must be an unsigned integer");
+  constexpr auto nAlternatives = vahinternal::variant_size_v<V>;
+  auto counts = std::array<vahinternal::Num, nAlternatives>{};
+  // One vector pass per alternative beats scattered increments only while
+  // there are few alternatives
+  if constexpr (sizeof(Tag) == 1U && nAlternatives <= 8U) {
+    for (auto i = vahinternal::Num{}; i < nAlternatives; ++i) {
+      vahinternal::forEachMatchMask(
+          tags, n, i, [&count = counts[i]](auto, std::uint64_t const mask) {
+            count += vahinternal::popcount64(mask);
+          });
+    }
+  } else {
+    // Four interleaved tables so that runs of equal indices do not wait on
+    // the previous increment
+    vahinternal::Num partial[4][nAlternatives] = {};
+    auto k = vahinternal::Num{};
+    for (; k < n; ++k) {
+      if (tags[k] < nAlternatives) {
+        ++partial[k % 4U][tags[k]];
+      }
+    }
+    for (auto i = vahinternal::Num{}; i < nAlternatives; ++i) {
+      counts[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+    }
+  }
+  return counts;
+}
+
+// Sets bit k of bitmap, made of (n + 63) / 64 words, when tags[k] == index
+// and clears it otherwise
+template <class Tag>
+void selectIndex(Tag const* const tags, vahinternal::Num const n,
+                 vahinternal::Num const index, std::uint64_t* const bitmap) {
+  static_assert(std::is_unsigned_v<Tag>, "Tag must be an unsigned integer");
+  std::fill(bitmap, bitmap + (n + 63U) / 64U, std::uint64_t{});
+  vahinternal::forEachMatchMask(
+      tags, n, index, [bitmap](vahinternal::Num const offset,
+                               std::uint64_t const mask) {
+        bitmap[offset / 64U] = mask;
+      });
+}
+
+// Writes every k with tags[k] == index to result in increasing order
+template <class Tag, class OutIt>
+auto indicesOf(Tag const* const tags, vahinternal::Num const n,
+               vahinternal::Num const index, OutIt result) -> OutIt {
+  static_assert(std::is_unsigned_v<Tag>, "Tag must be an unsigned integer");
+  vahinternal::forEachMatchMask(
+      tags, n, index,
+      [&result](vahinternal::Num const offset, std::uint64_t mask) {
+        for (; mask != 0U; mask &= mask - 1U) {
+          *result = offset + vahinternal::countTrailingZeros64(mask);
+          ++result;
+        }
+      });
+  return result;
+}
+}  // namespace csari::vah
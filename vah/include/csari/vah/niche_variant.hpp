@@ -0,0 +1,201 @@
+#pragma once
+#include <csari/vah.hpp>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <variant>
+namespace csari::vah {
+// Describes representations of T that never hold a real value. niche_variant
+// stores its empty alternatives as these values, so the index costs no
+// storage. Specializations provide
+//   static constexpr Num count;                  number of niche values
+//   static auto niche(Num i) -> T;               niche value i < count
+//   static auto niche_index(T const&) -> Num;    i for niche i, else count
+template <class T, class = void>
+struct niche_traits {
+  static constexpr vahinternal::Num count = 0U;
+};
+// Addresses below the alignment of T never point to a T
+template <class T>
+struct niche_traits<T*, std::enable_if_t<(alignof(T) > 1U)>> {
+  static constexpr vahinternal::Num count = alignof(T) - 1U;
+  static auto niche(vahinternal::Num const i) -> T* {
+    return reinterpret_cast<T*>(static_cast<std::uintptr_t>(i + 1U));
+  }
+  static auto niche_index(T* const val) -> vahinternal::Num {
+    auto const address = reinterpret_cast<std::uintptr_t>(val);
+    return address != 0U && address <= count
+               ? static_cast<vahinternal::Num>(address - 1U)
+               : count;
+  }
+};
+template <class... Ts>
+class niche_variant;
+}  // namespace csari::vah
+namespace std {
+template <class... Ts>
+struct variant_size<csari::vah::niche_variant<Ts...>>
+    : integral_constant<size_t, sizeof...(Ts)> {};
+template <size_t I, class... Ts>
+struct variant_alternative<I, csari::vah::niche_variant<Ts...>>
+    : variant_alternative<I, variant<Ts...>> {};
+}  // namespace std
+namespace csari::vah::vahinternal {
+// The one alternative holding data and the niche of every other alternative
+template <class... Ts>
+struct NicheLayout {
+  static constexpr Num dataIndex = [] {
+    constexpr bool empty[] = {std::is_empty_v<Ts>...};
+    auto index = sizeof...(Ts);
+    for (auto i = Num{}; i < sizeof...(Ts); ++i) {
+      if (!empty[i]) {
+        index = index == sizeof...(Ts) ? i : sizeof...(Ts) + 1U;
+      }
+    }
+    return index;
+  }();
+  static_assert(dataIndex < sizeof...(Ts),
+                "niche_variant needs exactly one non empty alternative");
+  using Data = variant_t<dataIndex, std::variant<Ts...>>;
+  static_assert(niche_traits<Data>::count + 1U >= sizeof...(Ts),
+                "not enough niche values for the empty alternatives");
+  // Alternative I is stored as niche I, or I - 1 after the data alternative
+  static constexpr auto nicheOf(Num const index) -> Num {
+    return index < dataIndex ? index : index - 1U;
+  }
+  static constexpr auto indexOf(Num const niche) -> Num {
+    return niche < dataIndex ? niche : niche + 1U;
+  }
+};
+// Empty alternatives carry no state, every niche_variant shares one
+template <class T>
+inline T emptyAlternative{};
+}  // namespace csari::vah::vahinternal
+namespace csari::vah {
+// Variant of one alternative holding data and any number of empty ones, such
+// as std::monostate or tag types. The empty alternatives are stored as niche
+// values of the data alternative, see niche_traits, so the variant is as
+// large as its data. Storing a niche value as the data alternative is not
+// allowed. Works with every vah entry point taking a variant.
+template <class... Ts>
+class niche_variant final {
+  using Layout = vahinternal::NicheLayout<Ts...>;
+  using Data = typename Layout::Data;
+  using Traits = niche_traits<Data>;
+
+ public:
+  niche_variant() : niche_variant{std::in_place_index<0>} {}
+  template <vahinternal::Num I, class... Args>
+  explicit niche_variant(std::in_place_index_t<I> /*unused*/, Args&&... args)
+      : value{make<I>(vahinternal::forward<Args>(args)...)} {}
+  template <class T, class... Args,
+            class = std::enable_if_t<vahinternal::isAlternative<T, Ts...>>>
+  explicit niche_variant(std::in_place_type_t<T> /*unused*/, Args&&... args)
+      : niche_variant{std::in_place_index<VariantIndex<niche_variant, T>>,
+                      vahinternal::forward<Args>(args)...} {}
+  // Only exact alternatives convert, there is no overload resolution
+  template <class T, class U = std::remove_cv_t<std::remove_reference_t<T>>,
+            class = std::enable_if_t<vahinternal::isAlternative<U, Ts...>>>
+  niche_variant(T&& val)  // NOLINT(google-explicit-constructor)
+      : niche_variant{std::in_place_type<U>, vahinternal::forward<T>(val)} {}
+
+  [[nodiscard]] auto index() const -> vahinternal::Num {
+    auto const niche = Traits::niche_index(value);
+    return niche + 1U < sizeof...(Ts) ? Layout::indexOf(niche)
+                                      : Layout::dataIndex;
+  }
+  [[nodiscard]] constexpr auto valueless_by_exception() const -> bool {
+    return false;
+  }
+
+  template <vahinternal::Num I, class... Args>
+  auto emplace(Args&&... args) -> vahinternal::variant_t<I, niche_variant>& {
+    value = make<I>(vahinternal::forward<Args>(args)...);
+    return alternative<I>();
+  }
+  template <class T, class... Args,
+            class = std::enable_if_t<vahinternal::isAlternative<T, Ts...>>>
+  auto emplace(Args&&... args) -> T& {
+    return emplace<VariantIndex<niche_variant, T>>(
+        vahinternal::forward<Args>(args)...);
+  }
+
+  friend auto operator==(niche_variant const& lhs, niche_variant const& rhs)
+      -> bool {
+    auto const index = lhs.index();
+    return index == rhs.index() &&
+           (index != Layout::dataIndex || lhs.value == rhs.value);
+  }
+  friend auto operator!=(niche_variant const& lhs, niche_variant const& rhs)
+      -> bool {
+    return !(lhs == rhs);
+  }
+
+  // Unchecked access to alternative I
+  template <vahinternal::Num I>
+  auto alternative() -> vahinternal::variant_t<I, niche_variant>& {
+    if constexpr (I == Layout::dataIndex) {
+      return value;
+    } else {
+      return vahinternal::emptyAlternative<
+          vahinternal::variant_t<I, niche_variant>>;
+    }
+  }
+  template <vahinternal::Num I>
+  auto alternative() const -> vahinternal::variant_t<I, niche_variant> const& {
+    if constexpr (I == Layout::dataIndex) {
+      return value;
+    } else {
+      return vahinternal::emptyAlternative<
+          vahinternal::variant_t<I, niche_variant>>;
+    }
+  }
+
+ private:
+  template <vahinternal::Num I, class... Args>
+  static auto make(Args&&... args) -> Data {
+    if constexpr (I == Layout::dataIndex) {
+      return Data(vahinternal::forward<Args>(args)...);
+    } else {
+      // Empty alternatives are still built so that their arguments are
+      // checked and their side effects happen
+      (void)vahinternal::variant_t<I, niche_variant>(
+          vahinternal::forward<Args>(args)...);
+      return Traits::niche(Layout::nicheOf(I));
+    }
+  }
+
+  Data value;
+};
+
+// Same contract as std::get, throws std::bad_variant_access when alternative
+// I is not active
+template <vahinternal::Num I, class... Ts>
+auto get(niche_variant<Ts...>& variantData)
+    -> vahinternal::variant_t<I, niche_variant<Ts...>>& {
+  if (variantData.index() != I) {
+    throw std::bad_variant_access{};
+  }
+  return variantData.template alternative<I>();
+}
+template <vahinternal::Num I, class... Ts>
+auto get(niche_variant<Ts...> const& variantData)
+    -> vahinternal::variant_t<I, niche_variant<Ts...>> const& {
+  if (variantData.index() != I) {
+    throw std::bad_variant_access{};
+  }
+  return variantData.template alternative<I>();
+}
+template <class T, class... Ts>
+auto get(niche_variant<Ts...>& variantData) -> T& {
+  return get<VariantIndex<niche_variant<Ts...>, T>>(variantData);
+}
+template <class T, class... Ts>
+auto get(niche_variant<Ts...> const& variantData) -> T const& {
+  return get<VariantIndex<niche_variant<Ts...>, T>>(variantData);
+}
+template <class T, class... Ts>
+auto holds_alternative(niche_variant<Ts...> const& variantData) -> bool {
+  return variantData.index() == VariantIndex<niche_variant<Ts...>, T>;
+}
+}  // namespace csari::vah
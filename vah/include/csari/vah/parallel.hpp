@@ -0,0 +1,59 @@
+#pragma once
+#include <csari/vah/stream_view.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+namespace csari::vah {
+// Decodes the stream described by index into result, resized to
+// index.size(), with up to nThreads threads taking one chunk at a time. Each
+// element is decoded straight into its slot, so V must be default
+// constructible. Returns false when a chunk does not hold the number of
+// elements the footer promises, result is left with default constructed
+// elements in that case. Nothing is allocated when the stream is too short
+// for index.size() elements, result is left empty then.
+template <class V, TagEncoding encoding>
+auto deserializeParallel(stream_index<V, encoding> const& index,
+                         std::vector<V>& result,
+                         vahinternal::Num nThreads =
+                             std::thread::hardware_concurrency()) -> bool {
+  using vahinternal::Num;
+  result.clear();
+  if (index.size() > index.stream().size_bytes() /
+                         vahinternal::smallestElementSize<encoding, V>()) {
+    return false;
+  }
+  result.resize(index.size());
+  auto const nChunks = index.chunks();
+  auto const stride = index.chunk_size();
+  auto nextChunk = std::atomic<Num>{};
+  auto valid = std::atomic<bool>{true};
+  auto const work = [&] {
+    for (auto j = nextChunk++; j < nChunks && valid; j = nextChunk++) {
+      auto const chunkFirst = j * stride;
+      auto const chunkSize = std::min(stride, index.size() - chunkFirst);
+      auto const view = index.chunk(j);
+      auto k = Num{};
+      auto it = view.begin();
+      for (auto const itEnd = view.end(); it != itEnd && k < chunkSize;
+           ++it, ++k) {
+        it->emplace_into(result[chunkFirst + k]);
+      }
+      if (k != chunkSize || it != view.end()) {
+        valid = false;
+      }
+    }
+  };
+  nThreads = std::clamp(nThreads, Num{1}, std::max(nChunks, Num{1}));
+  auto threads = std::vector<std::thread>{};
+  threads.reserve(nThreads - 1U);
+  for (auto t = Num{1}; t < nThreads; ++t) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return valid;
+}
+}  // namespace csari::vah
@@ -0,0 +1,213 @@
+#pragma once
+#include <csari/vah.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+namespace csari::vah::vahinternal {
+// Fewer elements than this per thread are partitioned on the calling thread
+constexpr auto partitionGrain = Num{1} << 15U;
+
+template <class It>
+using IteratedVariant = std::remove_cv_t<
+    std::remove_reference_t<decltype(*std::declval<It&>())>>;
+
+// Calls f on alternative I of every element in [first, last), which must
+// all hold I
+template <Num I, class It, class F>
+void forEachAlternativeIn(It first, It const last, F& f) {
+  for (; first != last; ++first) {
+    f(get<I>(*first));
+  }
+}
+
+// Runs f(t) for every t in [0, nThreads), t = 0 on the calling thread
+template <class F>
+void runOnThreads(Num const nThreads, F const& f) {
+  auto threads = std::vector<std::thread>{};
+  threads.reserve(nThreads - 1U);
+  for (auto t = Num{1}; t < nThreads; ++t) {
+    threads.emplace_back(f, t);
+  }
+  f(Num{});
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Stable counting sort of [first, last) by index() into buffer, which holds
+// at least as many elements. Returns the offset of every alternative in
+// buffer followed by the total count. Throws std::bad_variant_access without
+// touching either range when an element is valueless.
+template <class It, class V>
+auto scatterByIndex(It const first, It const last, std::vector<V>& buffer,
+                    Num nThreads) -> std::array<Num, variant_size_v<V> + 1U> {
+  constexpr auto nAlternatives = variant_size_v<V>;
+  using Counts = std::array<Num, nAlternatives>;
+  auto const n = static_cast<Num>(std::distance(first, last));
+  nThreads = std::clamp(std::min(nThreads, n / partitionGrain), Num{1},
+                        std::max(n, Num{1}));
+  auto const chunk = (n + nThreads - 1U) / nThreads;
+  auto const chunkFirst = [first, n, chunk](Num const t) {
+    return std::next(first,
+                     static_cast<std::ptrdiff_t>(std::min(t * chunk, n)));
+  };
+
+  // Each thread counts its own chunk, then writes to its own slice of every
+  // alternative so that the order of equal indices is kept
+  auto cursors = std::vector<Counts>(nThreads);
+  auto valueless = std::atomic<bool>{};
+  runOnThreads(nThreads, [&](Num const t) {
+    auto& counts = cursors[t];
+    for (auto it = chunkFirst(t), itEnd = chunkFirst(t + 1U); it != itEnd;
+         ++it) {
+      auto const index = it->index();
+      if (index >= nAlternatives) {
+        valueless = true;
+        return;
+      }
+      ++counts[index];
+    }
+  });
+  if (valueless) {
+    throw std::bad_variant_access{};
+  }
+  auto offsets = std::array<Num, nAlternatives + 1U>{};
+  auto offset = Num{};
+  for (auto i = Num{}; i < nAlternatives; ++i) {
+    offsets[i] = offset;
+    for (auto& counts : cursors) {
+      offset += std::exchange(counts[i], offset);
+    }
+  }
+  offsets[nAlternatives] = offset;
+
+  runOnThreads(nThreads, [&](Num const t) {
+    auto& cursor = cursors[t];
+    for (auto it = chunkFirst(t), itEnd = chunkFirst(t + 1U); it != itEnd;
+         ++it) {
+      buffer[cursor[it->index()]++] = std::move(*it);
+    }
+  });
+  return offsets;
+}
+}  // namespace csari::vah::vahinternal
+namespace csari::vah {
+// Elements of a range grouped by alternative. The elements holding
+// alternative I are [begin<I>(), end<I>()), in their original order.
+template <class It>
+class index_partition final {
+ public:
+  using iterator = It;
+  using variant_type = vahinternal::IteratedVariant<It>;
+  using size_type = vahinternal::Num;
+  static constexpr auto nAlternatives =
+      vahinternal::variant_size_v<variant_type>;
+
+  index_partition(It const first,
+                  std::array<size_type, nAlternatives + 1U> const& offsets)
+      : first{first}, offsets{offsets} {}
+
+  template <size_type I>
+  [[nodiscard]] auto begin() const -> It {
+    return std::next(first, static_cast<std::ptrdiff_t>(offsets[I]));
+  }
+  template <size_type I>
+  [[nodiscard]] auto end() const -> It {
+    return std::next(first, static_cast<std::ptrdiff_t>(offsets[I + 1U]));
+  }
+  template <size_type I>
+  [[nodiscard]] auto size() const -> size_type {
+    return offsets[I + 1U] - offsets[I];
+  }
+  template <class T>
+  [[nodiscard]] auto begin() const -> It {
+    return begin<VariantIndex<variant_type, T>>();
+  }
+  template <class T>
+  [[nodiscard]] auto end() const -> It {
+    return end<VariantIndex<variant_type, T>>();
+  }
+  template <class T>
+  [[nodiscard]] auto size() const -> size_type {
+    return size<VariantIndex<variant_type, T>>();
+  }
+
+  // Calls f on the alternative of every element holding I, in one loop
+  // that needs no dispatch
+  template <size_type I, class F>
+  void for_each(F&& f) const {
+    vahinternal::forEachAlternativeIn<I>(begin<I>(), end<I>(), f);
+  }
+  template <class T, class F>
+  void for_each(F&& f) const {
+    for_each<VariantIndex<variant_type, T>>(f);
+  }
+  // Calls f on every element, one loop per alternative
+  template <class F>
+  void for_each(F&& f) const {
+    forEachIndex(f, vahinternal::make_index_sequence<nAlternatives>{});
+  }
+
+ private:
+  template <class F, size_type... Is>
+  void forEachIndex(F& f, vahinternal::index_sequence<Is...>) const {
+    (for_each<Is>(f), ...);
+  }
+
+  It first;
+  std::array<size_type, nAlternatives + 1U> offsets;
+};
+
+// Reorders [first, last) so that the elements are grouped by index(),
+// alternative 0 first, keeping the order within each group. One counting
+// pass and one scatter pass into a buffer of default constructed elements,
+// split over up to nThreads threads when the range is large. Throws
+// std::bad_variant_access and leaves the range untouched when an element is
+// valueless.
+template <class It>
+auto partition_by_index(It const first, It const last,
+                        vahinternal::Num const nThreads =
+                            std::thread::hardware_concurrency())
+    -> index_partition<It> {
+  using V = vahinternal::IteratedVariant<It>;
+  static_assert(std::is_nothrow_move_assignable_v<V>,
+                "partition_by_index requires nothrow move assignable "
+                "variants");
+  auto buffer = std::vector<V>(
+      static_cast<vahinternal::Num>(std::distance(first, last)));
+  auto const offsets =
+      vahinternal::scatterByIndex(first, last, buffer, nThreads);
+  std::move(buffer.begin(), buffer.end(), first);
+  return index_partition<It>{first, offsets};
+}
+template <class Range>
+auto partition_by_index(Range& range,
+                        vahinternal::Num const nThreads =
+                            std::thread::hardware_concurrency()) {
+  using std::begin;
+  using std::end;
+  return partition_by_index(begin(range), end(range), nThreads);
+}
+// Same as above, the vector takes over the buffer instead of moving the
+// elements back
+template <class V>
+auto partition_by_index(std::vector<V>& vec,
+                        vahinternal::Num const nThreads =
+                            std::thread::hardware_concurrency())
+    -> index_partition<typename std::vector<V>::iterator> {
+  static_assert(std::is_nothrow_move_assignable_v<V>,
+                "partition_by_index requires nothrow move assignable "
+                "variants");
+  auto buffer = std::vector<V>(vec.size());
+  auto const offsets =
+      vahinternal::scatterByIndex(vec.begin(), vec.end(), buffer, nThreads);
+  vec.swap(buffer);
+  return index_partition<typename std::vector<V>::iterator>{vec.begin(),
+                                                            offsets};
+}
+}  // namespace csari::vah
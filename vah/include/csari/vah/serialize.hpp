@@ -0,0 +1,534 @@
+#pragma once
+#include <csari/vah.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+namespace csari::vah {
+// How serialize writes the index of the active alternative
+enum class TagEncoding {
+  // Smallest unsigned type that holds every index of the variant
+  fixed,
+  // LEB128, 7 bits per byte, one byte for the first 128 alternatives
+  varint
+};
+}  // namespace csari::vah
+namespace csari::vah::vahinternal {
+// Smallest unsigned type able to hold every index of V
+template <class V>
+using IndexTag = SmallestIndex<variant_size_v<V>>;
+template <class V, class Seq = make_index_sequence<variant_size_v<V>>>
+struct WireLayout;
+template <class V, Num... Is>
+struct WireLayout<V, index_sequence<Is...>> {
+  static constexpr bool triviallyCopyable =
+      (std::is_trivially_copyable_v<variant_t<Is, V>> && ...);
+  // Bytes of each alternative, indexed by alternative
+  static constexpr Num sizes[] = {sizeof(variant_t<Is, V>)...};
+};
+constexpr auto varintSize(Num value) -> Num {
+  auto size = Num{1};
+  for (; value >= 0x80U; value >>= 7U) {
+    ++size;
+  }
+  return size;
+}
+template <TagEncoding encoding, class V>
+constexpr auto tagSize(Num const index) -> Num {
+  if constexpr (encoding == TagEncoding::fixed) {
+    (void)index;
+    return sizeof(IndexTag<V>);
+  } else {
+    return varintSize(index);
+  }
+}
+// Caller guarantees room for tagSize bytes
+template <TagEncoding encoding, class V>
+void writeTag(Num const index, std::byte* const first) {
+  if constexpr (encoding == TagEncoding::fixed) {
+    auto const tag = static_cast<IndexTag<V>>(index);
+    std::memcpy(first, &tag, sizeof(tag));
+  } else {
+    auto value = index;
+    auto* data = first;
+    for (; value >= 0x80U; value >>= 7U) {
+      *data++ = static_cast<std::byte>((value & 0x7FU) | 0x80U);
+    }
+    *data = static_cast<std::byte>(value);
+  }
+}
+// Returns the index and its tag size, or nullopt when [first, last) does not
+// start with the tag of an alternative of V
+template <TagEncoding encoding, class V>
+auto readTag(std::byte const* const first, std::byte const* const last)
+    -> optional<std::pair<Num, Num>> {
+  auto const available = static_cast<Num>(last - first);
+  auto index = Num{};
+  auto size = Num{};
+  if constexpr (encoding == TagEncoding::fixed) {
+    auto tag = IndexTag<V>{};
+    if (available < sizeof(tag)) {
+      return nullopt;
+    }
+    std::memcpy(&tag, first, sizeof(tag));
+    index = tag;
+    size = sizeof(tag);
+  } else {
+    // Longer encodings, including overlong ones, cannot name an alternative
+    constexpr auto maxSize = varintSize(variant_size_v<V> - 1);
+    auto byte = std::uint8_t{0x80U};
+    for (; (byte & 0x80U) != 0U; ++size) {
+      if (size == available || size == maxSize) {
+        return nullopt;
+      }
+      byte = static_cast<std::uint8_t>(first[size]);
+      index |= static_cast<Num>(byte & 0x7FU) << (7U * size);
+    }
+  }
+  if (index >= variant_size_v<V>) {
+    return nullopt;
+  }
+  return std::pair{index, size};
+}
+template <class T>
+constexpr auto typeSignature() -> std::string_view {
+#if defined(_MSC_VER) && !defined(__clang__)
+  return __FUNCSIG__;
+#else
+  return __PRETTY_FUNCTION__;
+#endif
+}
+// FNV-1a over the bytes of value, least significant first
+constexpr auto fnv1a(std::uint64_t hash, std::uint64_t const value)
+    -> std::uint64_t {
+  for (auto byte = 0U; byte < sizeof(value); ++byte) {
+    hash ^= (value >> (8U * byte)) & 0xFFU;
+    hash *= 0x100000001B3U;
+  }
+  return hash;
+}
+constexpr auto fnv1a(std::uint64_t hash, std::string_view const text)
+    -> std::uint64_t {
+  for (auto const c : text) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001B3U;
+  }
+  return hash;
+}
+template <class V, Num... Is>
+constexpr auto fingerprintOf(index_sequence<Is...>) -> std::uint64_t {
+  auto hash = fnv1a(0xCBF29CE484222325U, sizeof...(Is));
+  ((hash = fnv1a(fnv1a(fnv1a(hash, sizeof(variant_t<Is, V>)),
+                       alignof(variant_t<Is, V>)),
+                 typeSignature<variant_t<Is, V>>())),
+   ...);
+  return hash;
+}
+// Header of the block format
+struct BlockHeader {
+  std::uint64_t fingerprint;
+  std::uint64_t count;
+};
+// Header of the columnar format, offsets are relative to the block start.
+// Column I spans [offsets[I], offsets[I + 1]).
+template <class V>
+struct ColumnHeader {
+  std::uint64_t fingerprint;
+  std::uint64_t count;
+  std::uint64_t offsets[variant_size_v<V> + 1];
+};
+// Returns the header when it is consistent with itself and with the bytes
+// available in [first, last)
+template <class V>
+auto readColumnHeader(std::byte const* const first,
+                      std::byte const* const last)
+    -> optional<ColumnHeader<V>> {
+  auto const available = static_cast<Num>(last - first);
+  auto header = ColumnHeader<V>{};
+  if (available < sizeof(header)) {
+    return nullopt;
+  }
+  std::memcpy(&header, first, sizeof(header));
+  constexpr auto fingerprint =
+      fingerprintOf<V>(make_index_sequence<variant_size_v<V>>{});
+  if (header.fingerprint != fingerprint ||
+      header.count > (available - sizeof(header)) / sizeof(IndexTag<V>) ||
+      header.offsets[0] !=
+          sizeof(header) + header.count * sizeof(IndexTag<V>) ||
+      header.offsets[variant_size_v<V>] > available) {
+    return nullopt;
+  }
+  for (auto i = Num{}; i < variant_size_v<V>; ++i) {
+    if (header.offsets[i + 1] < header.offsets[i] ||
+        (header.offsets[i + 1] - header.offsets[i]) %
+                WireLayout<V>::sizes[i] !=
+            0U) {
+      return nullopt;
+    }
+  }
+  return header;
+}
+}  // namespace csari::vah::vahinternal
+namespace csari::vah {
+// Wire format: the index of the active alternative, see TagEncoding,
+// followed by the bytes of the alternative. Both are written in native byte
+// order without padding, so the reader must share the writer's layout.
+
+// Unsigned type TagEncoding::fixed writes the index of V as
+template <class V>
+using VariantIndexTag = vahinternal::IndexTag<V>;
+
+// Hash of the alternative count and the size, alignment and name of every
+// alternative. Streams carry it so that a reader built against a reordered
+// or extended V rejects them. Type names are spelled by the compiler, so
+// writer and reader must be built with the same one.
+template <class V>
+constexpr std::uint64_t VariantFingerprint = vahinternal::fingerprintOf<V>(
+    vahinternal::make_index_sequence<vahinternal::variant_size_v<V>>{});
+
+// Writes the fingerprint of V to [first, last) and advances first past it.
+// Streams of serialize calls start with it. Returns false when the buffer is
+// too small.
+template <class V>
+auto serializeHeader(std::byte*& first, std::byte* const last) -> bool {
+  auto const fingerprint = VariantFingerprint<V>;
+  if (static_cast<vahinternal::Num>(last - first) < sizeof(fingerprint)) {
+    return false;
+  }
+  std::memcpy(first, &fingerprint, sizeof(fingerprint));
+  first += sizeof(fingerprint);
+  return true;
+}
+// Checks a header written by serializeHeader and advances first past it.
+// Returns false and leaves first untouched when it was written for another
+// variant.
+template <class V>
+auto deserializeHeader(std::byte const*& first, std::byte const* const last)
+    -> bool {
+  auto fingerprint = std::uint64_t{};
+  if (static_cast<vahinternal::Num>(last - first) < sizeof(fingerprint)) {
+    return false;
+  }
+  std::memcpy(&fingerprint, first, sizeof(fingerprint));
+  if (fingerprint != VariantFingerprint<V>) {
+    return false;
+  }
+  first += sizeof(fingerprint);
+  return true;
+}
+
+// Bytes serialize writes for variantData. Throws std::bad_variant_access when
+// variantData is valueless.
+template <TagEncoding encoding = TagEncoding::fixed, class V>
+constexpr auto serializedSize(V const& variantData) -> vahinternal::Num {
+  auto const index = variantData.index();
+  if (index >= vahinternal::variant_size_v<V>) {
+    throw std::bad_variant_access{};
+  }
+  return vahinternal::tagSize<encoding, V>(index) +
+         vahinternal::WireLayout<V>::sizes[index];
+}
+
+// Writes variantData to [first, last) and advances first past it. Returns
+// false and writes nothing when the buffer is too small. Throws
+// std::bad_variant_access when variantData is valueless.
+template <TagEncoding encoding = TagEncoding::fixed, class V>
+auto serialize(V const& variantData, std::byte*& first, std::byte* const last)
+    -> bool {
+  static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                "serialize requires trivially copyable alternatives");
+  auto const size = serializedSize<encoding>(variantData);
+  if (static_cast<vahinternal::Num>(last - first) < size) {
+    return false;
+  }
+  auto const index = variantData.index();
+  vahinternal::writeTag<encoding, V>(index, first);
+  performOnData(variantData, [data = first + vahinternal::tagSize<encoding, V>(
+                                                 index)](auto const& val) {
+    std::memcpy(data, &val, sizeof(val));
+  });
+  first += size;
+  return true;
+}
+
+// Reads one variant written by serialize from [first, last) and advances
+// first past it. Returns nullopt and leaves first untouched when the buffer
+// is truncated or holds an unknown index.
+template <class V, TagEncoding encoding = TagEncoding::fixed>
+auto deserialize(std::byte const*& first, std::byte const* const last)
+    -> vahinternal::optional<V> {
+  static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                "deserialize requires trivially copyable alternatives");
+  auto const tag = vahinternal::readTag<encoding, V>(first, last);
+  if (!tag) {
+    return vahinternal::nullopt;
+  }
+  auto const [index, tagSize] = *tag;
+  auto const size = tagSize + vahinternal::WireLayout<V>::sizes[index];
+  if (static_cast<vahinternal::Num>(last - first) < size) {
+    return vahinternal::nullopt;
+  }
+  auto variantData = constructAndPerformOnData<V>(
+      index, [data = first + tagSize](auto& val) {
+        std::memcpy(&val, data, sizeof(val));
+      });
+  first += size;
+  return variantData;
+}
+
+// Block format for ranges: the fingerprint of V and the element count as
+// std::uint64_t, the fixed width index of every element, then the
+// alternatives packed back to back. Both arrays are written and read in one
+// linear pass each.
+
+// Bytes serializeRange writes for [first, last). Throws
+// std::bad_variant_access when an element is valueless.
+template <class It>
+auto serializedRangeSize(It first, It const last) -> vahinternal::Num {
+  auto size = sizeof(vahinternal::BlockHeader);
+  for (; first != last; ++first) {
+    size += serializedSize(*first);
+  }
+  return size;
+}
+
+// Writes [first, last) to [out, outLast) in the block format and advances out
+// past it. Returns false and writes nothing when the buffer is too small.
+template <class It>
+auto serializeRange(It const first, It const last, std::byte*& out,
+                    std::byte* const outLast) -> bool {
+  using V = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+  static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                "serializeRange requires trivially copyable alternatives");
+  auto const size = serializedRangeSize(first, last);
+  if (static_cast<vahinternal::Num>(outLast - out) < size) {
+    return false;
+  }
+  auto const header = vahinternal::BlockHeader{
+      VariantFingerprint<V>,
+      static_cast<std::uint64_t>(std::distance(first, last))};
+  std::memcpy(out, &header, sizeof(header));
+  auto* tags = out + sizeof(header);
+  for (auto it = first; it != last; ++it) {
+    auto const tag = static_cast<vahinternal::IndexTag<V>>(it->index());
+    std::memcpy(tags, &tag, sizeof(tag));
+    tags += sizeof(tag);
+  }
+  // Runs of equal alternatives are copied without dispatching in between
+  performOnRange(first, last, [payload = tags](auto const& val) mutable {
+    std::memcpy(payload, &val, sizeof(val));
+    payload += sizeof(val);
+  });
+  out += size;
+  return true;
+}
+template <class Range>
+auto serializeRange(Range const& range, std::byte*& out,
+                    std::byte* const outLast) -> bool {
+  using std::begin;
+  using std::end;
+  return serializeRange(begin(range), end(range), out, outLast);
+}
+
+// Reads a block written by serializeRange from [first, last) into result and
+// advances first past it. Every index and the total length are checked
+// before anything is constructed. Returns false and leaves first untouched
+// when the block is truncated, holds an unknown index or was written for
+// another variant.
+template <class V, class OutIt>
+auto deserializeRange(std::byte const*& first, std::byte const* const last,
+                      OutIt result) -> bool {
+  static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                "deserializeRange requires trivially copyable alternatives");
+  using Tag = vahinternal::IndexTag<V>;
+  auto const available = static_cast<vahinternal::Num>(last - first);
+  auto header = vahinternal::BlockHeader{};
+  if (available < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, first, sizeof(header));
+  auto const count = header.count;
+  if (header.fingerprint != VariantFingerprint<V> ||
+      count > (available - sizeof(header)) / sizeof(Tag)) {
+    return false;
+  }
+  auto const* const tags = first + sizeof(header);
+  auto const* const payload = tags + count * sizeof(Tag);
+  auto payloadSize = vahinternal::Num{};
+  for (auto i = std::uint64_t{}; i < count; ++i) {
+    auto tag = Tag{};
+    std::memcpy(&tag, tags + i * sizeof(Tag), sizeof(tag));
+    if (tag >= vahinternal::variant_size_v<V>) {
+      return false;
+    }
+    payloadSize += vahinternal::WireLayout<V>::sizes[tag];
+  }
+  if (static_cast<vahinternal::Num>(last - payload) < payloadSize) {
+    return false;
+  }
+  auto const* data = payload;
+  for (auto i = std::uint64_t{}; i < count; ++i) {
+    auto tag = Tag{};
+    std::memcpy(&tag, tags + i * sizeof(Tag), sizeof(tag));
+    *result = constructAndPerformOnData<V>(tag, [&data](auto& val) {
+      std::memcpy(&val, data, sizeof(val));
+      data += sizeof(val);
+    });
+    ++result;
+  }
+  first = payload + payloadSize;
+  return true;
+}
+
+// Columnar format for ranges: a header holding the fingerprint of V, the
+// element count and the byte offset of every column, the tag column, then
+// one column per alternative with its values packed in range order. A reader
+// interested in one alternative reads its column without touching the
+// others.
+
+// Bytes serializeColumns writes for [first, last). Throws
+// std::bad_variant_access when an element is valueless.
+template <class It>
+auto serializedColumnsSize(It const first, It const last) -> vahinternal::Num {
+  using V = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+  return serializedRangeSize(first, last) - sizeof(vahinternal::BlockHeader) +
+         sizeof(vahinternal::ColumnHeader<V>);
+}
+
+// Writes [first, last) to [out, outLast) in the columnar format and advances
+// out past it. Returns false and writes nothing when the buffer is too small.
+template <class It>
+auto serializeColumns(It const first, It const last, std::byte*& out,
+                      std::byte* const outLast) -> bool {
+  using V = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+  using vahinternal::Num;
+  static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                "serializeColumns requires trivially copyable alternatives");
+  constexpr auto nAlternatives = vahinternal::variant_size_v<V>;
+  auto const size = serializedColumnsSize(first, last);
+  if (static_cast<Num>(outLast - out) < size) {
+    return false;
+  }
+  Num counts[nAlternatives] = {};
+  for (auto it = first; it != last; ++it) {
+    ++counts[it->index()];
+  }
+  auto header = vahinternal::ColumnHeader<V>{};
+  header.fingerprint = VariantFingerprint<V>;
+  header.count = static_cast<std::uint64_t>(std::distance(first, last));
+  header.offsets[0] =
+      sizeof(header) + header.count * sizeof(vahinternal::IndexTag<V>);
+  for (auto i = Num{}; i < nAlternatives; ++i) {
+    header.offsets[i + 1] =
+        header.offsets[i] + counts[i] * vahinternal::WireLayout<V>::sizes[i];
+  }
+  std::memcpy(out, &header, sizeof(header));
+  std::byte* columns[nAlternatives] = {};
+  for (auto i = Num{}; i < nAlternatives; ++i) {
+    columns[i] = out + header.offsets[i];
+  }
+  auto* tags = out + sizeof(header);
+  for (auto it = first; it != last; ++it) {
+    auto const tag = static_cast<vahinternal::IndexTag<V>>(it->index());
+    std::memcpy(tags, &tag, sizeof(tag));
+    tags += sizeof(tag);
+    vahinternal::forIndexWithJumpTable<nAlternatives>(
+        it->index(), [&columns, &it](auto i) {
+          auto const& val = std::get<i.value>(*it);
+          std::memcpy(columns[i.value], &val, sizeof(val));
+          columns[i.value] += sizeof(val);
+        });
+  }
+  out += size;
+  return true;
+}
+template <class Range>
+auto serializeColumns(Range const& range, std::byte*& out,
+                      std::byte* const outLast) -> bool {
+  using std::begin;
+  using std::end;
+  return serializeColumns(begin(range), end(range), out, outLast);
+}
+
+// Copies the values of alternative I from a block written by
+// serializeColumns into result, in range order, and advances first past the
+// block. Returns false and leaves first untouched when the header is
+// inconsistent, the block is truncated or was written for another variant.
+template <class V, vahinternal::Num I, class OutIt>
+auto deserializeColumn(std::byte const*& first, std::byte const* const last,
+                       OutIt result) -> bool {
+  using T = vahinternal::variant_t<I, V>;
+  static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                "deserializeColumn requires trivially copyable alternatives");
+  auto const header = vahinternal::readColumnHeader<V>(first, last);
+  if (!header) {
+    return false;
+  }
+  auto const* const column = first + header->offsets[I];
+  auto const count = (header->offsets[I + 1] - header->offsets[I]) / sizeof(T);
+  for (auto k = std::uint64_t{}; k < count; ++k) {
+    auto val = T{};
+    std::memcpy(&val, column + k * sizeof(T), sizeof(T));
+    *result = val;
+    ++result;
+  }
+  first += header->offsets[vahinternal::variant_size_v<V>];
+  return true;
+}
+template <class V, class T, class OutIt>
+auto deserializeColumn(std::byte const*& first, std::byte const* const last,
+                       OutIt result) -> bool {
+  return deserializeColumn<V, VariantIndex<V, T>>(first, last, result);
+}
+
+// Rebuilds the whole range from a block written by serializeColumns, in its
+// original order, and advances first past the block. Returns false and leaves
+// first untouched when the block is inconsistent or was written for another
+// variant, nothing is constructed then.
+template <class V, class OutIt>
+auto deserializeColumns(std::byte const*& first, std::byte const* const last,
+                        OutIt result) -> bool {
+  using vahinternal::Num;
+  using Tag = vahinternal::IndexTag<V>;
+  static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                "deserializeColumns requires trivially copyable alternatives");
+  constexpr auto nAlternatives = vahinternal::variant_size_v<V>;
+  auto const header = vahinternal::readColumnHeader<V>(first, last);
+  if (!header) {
+    return false;
+  }
+  auto const* const tags = first + sizeof(*header);
+  // Every tag must be known and the columns must hold exactly the tagged
+  // values
+  Num counts[nAlternatives] = {};
+  for (auto k = std::uint64_t{}; k < header->count; ++k) {
+    auto tag = Tag{};
+    std::memcpy(&tag, tags + k * sizeof(Tag), sizeof(tag));
+    if (tag >= nAlternatives) {
+      return false;
+    }
+    ++counts[tag];
+  }
+  std::byte const* columns[nAlternatives] = {};
+  for (auto i = Num{}; i < nAlternatives; ++i) {
+    if (counts[i] * vahinternal::WireLayout<V>::sizes[i] !=
+        header->offsets[i + 1] - header->offsets[i]) {
+      return false;
+    }
+    columns[i] = first + header->offsets[i];
+  }
+  for (auto k = std::uint64_t{}; k < header->count; ++k) {
+    auto tag = Tag{};
+    std::memcpy(&tag, tags + k * sizeof(Tag), sizeof(tag));
+    *result = constructAndPerformOnData<V>(tag, [&columns, tag](auto& val) {
+      std::memcpy(&val, columns[tag], sizeof(val));
+      columns[tag] += sizeof(val);
+    });
+    ++result;
+  }
+  first += header->offsets[nAlternatives];
+  return true;
+}
+}  // namespace csari::vah
@@ -0,0 +1,187 @@
+#pragma once
+#include <csari/vah.hpp>
+#include <csari/vah/index_kernels.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+namespace csari::vah::vahinternal {
+// Storage for any alternative of V, every slot has the same stride
+template <class V, class Seq = make_index_sequence<variant_size_v<V>>>
+struct PayloadSlotOf;
+template <class V, Num... Is>
+struct PayloadSlotOf<V, index_sequence<Is...>> {
+  static_assert((std::is_trivially_copyable_v<variant_t<Is, V>> && ...),
+                "split_variant_vector requires trivially copyable "
+                "alternatives");
+  struct alignas(variant_t<Is, V>...) type {
+    std::byte bytes[std::max({sizeof(variant_t<Is, V>)...})];
+  };
+};
+}  // namespace csari::vah::vahinternal
+namespace csari::vah {
+// Stores the indices of its elements in one dense array and their
+// alternatives in a second array of equal sized slots. Queries on the
+// indices alone, such as count, find and partition, run over the index
+// array only and never touch the alternatives. count and find compare 16 or
+// 32 indices at a time with SSE2 or AVX2 where available, see
+// index_kernels.hpp. Insertion order is kept.
+template <class V>
+class split_variant_vector final {
+  using Slot = typename vahinternal::PayloadSlotOf<V>::type;
+
+ public:
+  using variant_type = V;
+  using size_type = vahinternal::Num;
+  using tag_type = vahinternal::SmallestIndex<vahinternal::variant_size_v<V>>;
+
+  void push_back(V const& variantData) {
+    if (variantData.valueless_by_exception()) {
+      throw std::bad_variant_access{};
+    }
+    vahinternal::forIndexWithJumpTable<vahinternal::variant_size_v<V>>(
+        variantData.index(), [this, &variantData](auto i) {
+          emplace_back<i.value>(std::get<i.value>(variantData));
+        });
+  }
+  template <size_type I, class... Ts>
+  auto emplace_back(Ts&&... params) -> vahinternal::variant_t<I, V>& {
+    using T = vahinternal::variant_t<I, V>;
+    // Built aside first, a throwing constructor leaves the vector intact
+    auto val = T(vahinternal::forward<Ts>(params)...);
+    auto& slot = payloads.emplace_back();
+    try {
+      tags.push_back(static_cast<tag_type>(I));
+    } catch (...) {
+      payloads.pop_back();
+      throw;
+    }
+    return *::new (static_cast<void*>(slot.bytes)) T(val);
+  }
+  template <class T, class... Ts>
+  auto emplace_back(Ts&&... params) -> T& {
+    return emplace_back<VariantIndex<V, T>>(
+        vahinternal::forward<Ts>(params)...);
+  }
+
+  // Index of the alternative held by element k
+  [[nodiscard]] auto index(size_type const k) const -> size_type {
+    return tags[k];
+  }
+  // The dense index array, one entry per element
+  [[nodiscard]] auto indices() const -> std::vector<tag_type> const& {
+    return tags;
+  }
+  // Calls f with the alternative held by element k
+  template <class F>
+  void perform(size_type const k, F&& f) {
+    performOnSlot(payloads[k], tags[k], f);
+  }
+  template <class F>
+  void perform(size_type const k, F&& f) const {
+    performOnSlot(payloads[k], tags[k], f);
+  }
+  // Copy of element k as a V
+  [[nodiscard]] auto at(size_type const k) const -> V {
+    return vahinternal::forIndexWithJumpTable<vahinternal::variant_size_v<V>>(
+        tags[k], [this, k](auto i) -> V {
+          return V{std::in_place_index<i.value>,
+                   alternative<i.value>(payloads[k])};
+        });
+  }
+  // Calls f on every element in order
+  template <class F>
+  void for_each(F&& f) {
+    for (auto k = size_type{}; k < size(); ++k) {
+      performOnSlot(payloads[k], tags[k], f);
+    }
+  }
+  template <class F>
+  void for_each(F&& f) const {
+    for (auto k = size_type{}; k < size(); ++k) {
+      performOnSlot(payloads[k], tags[k], f);
+    }
+  }
+
+  // Number of elements holding alternative I
+  template <size_type I>
+  [[nodiscard]] auto count() const -> size_type {
+    return vahinternal::countMatches(tags.data(), tags.size(), I);
+  }
+  template <class T>
+  [[nodiscard]] auto count() const -> size_type {
+    return count<VariantIndex<V, T>>();
+  }
+  // First element at or after from holding alternative I, size() if none
+  template <size_type I>
+  [[nodiscard]] auto find(size_type const from = 0U) const -> size_type {
+    return vahinternal::findMatch(tags.data(), std::min(from, tags.size()),
+                                  tags.size(), I);
+  }
+  template <class T>
+  [[nodiscard]] auto find(size_type const from = 0U) const -> size_type {
+    return find<VariantIndex<V, T>>(from);
+  }
+  // Moves the elements holding alternative I to the front and returns their
+  // count. The order within both groups is not kept.
+  template <size_type I>
+  auto partition() -> size_type {
+    auto const tag = static_cast<tag_type>(I);
+    auto first = size_type{};
+    auto last = size();
+    while (true) {
+      while (first != last && tags[first] == tag) {
+        ++first;
+      }
+      while (first != last && tags[last - 1U] != tag) {
+        --last;
+      }
+      if (first == last) {
+        return first;
+      }
+      --last;
+      std::swap(tags[first], tags[last]);
+      std::swap(payloads[first], payloads[last]);
+      ++first;
+    }
+  }
+  template <class T>
+  auto partition() -> size_type {
+    return partition<VariantIndex<V, T>>();
+  }
+
+  [[nodiscard]] auto size() const -> size_type { return tags.size(); }
+  [[nodiscard]] auto empty() const -> bool { return tags.empty(); }
+  void reserve(size_type const capacity) {
+    tags.reserve(capacity);
+    payloads.reserve(capacity);
+  }
+  void clear() {
+    tags.clear();
+    payloads.clear();
+  }
+
+ private:
+  template <size_type I>
+  static auto alternative(Slot& slot) -> vahinternal::variant_t<I, V>& {
+    return *std::launder(
+        reinterpret_cast<vahinternal::variant_t<I, V>*>(slot.bytes));
+  }
+  template <size_type I>
+  static auto alternative(Slot const& slot)
+      -> vahinternal::variant_t<I, V> const& {
+    return *std::launder(
+        reinterpret_cast<vahinternal::variant_t<I, V> const*>(slot.bytes));
+  }
+  template <class S, class F>
+  static void performOnSlot(S& slot, tag_type const tag, F& f) {
+    vahinternal::forIndexWithJumpTable<vahinternal::variant_size_v<V>>(
+        tag, [&slot, &f](auto i) { f(alternative<i.value>(slot)); });
+  }
+
+  std::vector<tag_type> tags;
+  std::vector<Slot> payloads;
+};
+}  // namespace csari::vah
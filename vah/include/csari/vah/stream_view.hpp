@@ -0,0 +1,357 @@
+#pragma once
+#include <csari/vah/serialize.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <optional>
+namespace csari::vah::vahinternal {
+// Calls f with the T stored at data, in place when data is suitably aligned
+// and through a stack copy otherwise
+template <class T, class F>
+void performOnStored(std::byte const* const data, F& f) {
+  if (reinterpret_cast<std::uintptr_t>(data) % alignof(T) == 0U) {
+    f(*std::launder(reinterpret_cast<T const*>(data)));
+  } else {
+    alignas(T) std::byte copy[sizeof(T)];
+    std::memcpy(copy, data, sizeof(T));
+    f(*std::launder(reinterpret_cast<T const*>(copy)));
+  }
+}
+template <class T>
+auto loadUnaligned(std::byte const* const data) -> T {
+  auto val = T{};
+  std::memcpy(&val, data, sizeof(val));
+  return val;
+}
+// Bytes of the shortest element a stream of V can hold
+template <TagEncoding encoding, class V>
+constexpr auto smallestElementSize() -> Num {
+  auto smallest = tagSize<encoding, V>(0U) + WireLayout<V>::sizes[0];
+  for (auto i = Num{1}; i < variant_size_v<V>; ++i) {
+    smallest =
+        std::min(smallest, tagSize<encoding, V>(i) + WireLayout<V>::sizes[i]);
+  }
+  return smallest;
+}
+}  // namespace csari::vah::vahinternal
+namespace csari::vah {
+// Read only view over variants written back to back by serialize. Elements
+// are decoded one at a time while iterating, nothing is copied up front.
+// Iteration stops at the end of the buffer or at the first element that
+// cannot be decoded.
+template <class V, TagEncoding encoding = TagEncoding::fixed>
+class stream_view final {
+ public:
+  using variant_type = V;
+  using size_type = vahinternal::Num;
+
+  // One decoded tag and the bytes of its alternative
+  class element final {
+   public:
+    [[nodiscard]] auto index() const -> size_type { return alternative; }
+    // Decodes the alternative into a V
+    [[nodiscard]] auto value() const -> V {
+      return constructAndPerformOnData<V>(alternative, [this](auto& val) {
+        std::memcpy(&val, data, sizeof(val));
+      });
+    }
+    // Decodes the alternative into the storage of variantData
+    void emplace_into(V& variantData) const {
+      emplaceAndPerformOnData(variantData, alternative, [this](auto& val) {
+        std::memcpy(&val, data, sizeof(val));
+      });
+    }
+    // Calls f with a const reference to the alternative
+    template <class F>
+    void perform(F&& f) const {
+      vahinternal::forIndexWithJumpTable<vahinternal::variant_size_v<V>>(
+          alternative, [this, &f](auto i) {
+            vahinternal::performOnStored<vahinternal::variant_t<i.value, V>>(
+                data, f);
+          });
+    }
+
+   private:
+    friend class stream_view;
+    size_type alternative{};
+    std::byte const* data{};
+  };
+
+  class iterator final {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = element;
+    using difference_type = std::ptrdiff_t;
+    using pointer = element const*;
+    using reference = element const&;
+
+    iterator() = default;
+    auto operator*() const -> reference { return current; }
+    auto operator->() const -> pointer { return &current; }
+    auto operator++() -> iterator& {
+      first = next;
+      decode();
+      return *this;
+    }
+    auto operator++(int) -> iterator {
+      auto previous = *this;
+      ++*this;
+      return previous;
+    }
+    friend auto operator==(iterator const& lhs, iterator const& rhs) -> bool {
+      return lhs.first == rhs.first;
+    }
+    friend auto operator!=(iterator const& lhs, iterator const& rhs) -> bool {
+      return !(lhs == rhs);
+    }
+
+   private:
+    friend class stream_view;
+    iterator(std::byte const* const first, std::byte const* const last)
+        : first{first}, last{last} {
+      decode();
+    }
+    void decode() {
+      if (first == last) {
+        return;
+      }
+      auto const tag = vahinternal::readTag<encoding, V>(first, last);
+      if (!tag) {
+        stop();
+        return;
+      }
+      auto const [index, tagSize] = *tag;
+      auto const size = tagSize + vahinternal::WireLayout<V>::sizes[index];
+      if (static_cast<size_type>(last - first) < size) {
+        stop();
+        return;
+      }
+      current.alternative = index;
+      current.data = first + tagSize;
+      next = first + size;
+    }
+    // Compares equal to end from here on
+    void stop() {
+      first = last;
+      failed = true;
+    }
+
+    std::byte const* first{};
+    std::byte const* last{};
+    std::byte const* next{};
+    element current{};
+    bool failed{};
+  };
+
+  stream_view() = default;
+  stream_view(std::byte const* const first, std::byte const* const last)
+      : first{first}, last{last} {
+    static_assert(vahinternal::WireLayout<V>::triviallyCopyable,
+                  "stream_view requires trivially copyable alternatives");
+  }
+  stream_view(std::byte const* const data, size_type const size)
+      : stream_view{data, data + size} {}
+
+  [[nodiscard]] auto begin() const -> iterator { return {first, last}; }
+  [[nodiscard]] auto end() const -> iterator { return {last, last}; }
+  // Bytes in the viewed buffer
+  [[nodiscard]] auto size_bytes() const -> size_type {
+    return static_cast<size_type>(last - first);
+  }
+
+  // Calls f on every alternative in order. Returns false when decoding
+  // stopped before the end of the buffer.
+  template <class F>
+  auto for_each(F&& f) const -> bool {
+    auto it = begin();
+    auto const itEnd = end();
+    for (; it != itEnd; ++it) {
+      it->perform(f);
+    }
+    return !it.failed;
+  }
+
+ private:
+  std::byte const* first{};
+  std::byte const* last{};
+};
+
+// Optional footer after a stream written by serialize: the byte offset of
+// every stride-th element, the number of elements of each alternative, the
+// element count, the stride and VariantFingerprint<V>, all as
+// std::uint64_t. Readers find it from the end of the buffer.
+
+// Appends the footer for the stream [streamFirst, out) at out and advances
+// out past it. Returns false and leaves out untouched when the buffer is too
+// small, the stream does not decode or stride is zero.
+template <class V, TagEncoding encoding = TagEncoding::fixed>
+auto appendStreamIndex(std::byte const* const streamFirst, std::byte*& out,
+                       std::byte* const outLast, vahinternal::Num const stride)
+    -> bool {
+  using vahinternal::Num;
+  constexpr auto nAlternatives = vahinternal::variant_size_v<V>;
+  if (stride == 0U) {
+    return false;
+  }
+  auto written = Num{};
+  auto const write = [&out, outLast, &written](std::uint64_t const value) {
+    if (static_cast<Num>(outLast - out) - written < sizeof(value)) {
+      return false;
+    }
+    std::memcpy(out + written, &value, sizeof(value));
+    written += sizeof(value);
+    return true;
+  };
+  std::uint64_t counts[nAlternatives] = {};
+  auto count = std::uint64_t{};
+  for (auto const* position = streamFirst; position != out; ++count) {
+    auto const tag = vahinternal::readTag<encoding, V>(position, out);
+    if (!tag) {
+      return false;
+    }
+    auto const [index, tagSize] = *tag;
+    auto const size = tagSize + vahinternal::WireLayout<V>::sizes[index];
+    if (static_cast<Num>(out - position) < size) {
+      return false;
+    }
+    if (count % stride == 0U &&
+        !write(static_cast<std::uint64_t>(position - streamFirst))) {
+      return false;
+    }
+    ++counts[index];
+    position += size;
+  }
+  for (auto const n : counts) {
+    if (!write(n)) {
+      return false;
+    }
+  }
+  if (!write(count) || !write(stride) || !write(VariantFingerprint<V>)) {
+    return false;
+  }
+  out += written;
+  return true;
+}
+
+// Footer written by appendStreamIndex, giving element counts up front and
+// access to any element after decoding at most stride - 1 others
+template <class V, TagEncoding encoding = TagEncoding::fixed>
+class stream_index final {
+ public:
+  using view_type = stream_view<V, encoding>;
+  using size_type = vahinternal::Num;
+
+  // Returns nullopt when [first, last) does not end in a consistent footer
+  // written for V
+  static auto read(std::byte const* const first, std::byte const* const last)
+      -> std::optional<stream_index> {
+    constexpr auto word = sizeof(std::uint64_t);
+    constexpr auto nAlternatives = vahinternal::variant_size_v<V>;
+    auto const available = static_cast<size_type>(last - first) / word;
+    if (available < nAlternatives + 3U ||
+        vahinternal::loadUnaligned<std::uint64_t>(last - word) !=
+            VariantFingerprint<V>) {
+      return std::nullopt;
+    }
+    auto index = stream_index{};
+    index.count = vahinternal::loadUnaligned<std::uint64_t>(last - 3U * word);
+    index.stride = vahinternal::loadUnaligned<std::uint64_t>(last - 2U * word);
+    if (index.stride == 0U) {
+      return std::nullopt;
+    }
+    // Written without rounding up first so that a huge count cannot wrap
+    auto const nChunks =
+        index.count / index.stride + (index.count % index.stride != 0U);
+    if (nChunks > available - nAlternatives - 3U) {
+      return std::nullopt;
+    }
+    index.alternativeCounts = last - (nAlternatives + 3U) * word;
+    index.offsets = index.alternativeCounts - nChunks * word;
+    index.first = first;
+    index.last = index.offsets;
+    auto total = std::uint64_t{};
+    for (auto i = size_type{}; i < nAlternatives; ++i) {
+      total += index.count_of(i);
+    }
+    // Every chunk, and so the whole stream, must have room for its share of
+    // count even if all of it were the shortest element
+    constexpr auto smallest = vahinternal::smallestElementSize<encoding, V>();
+    auto const streamSize = static_cast<std::uint64_t>(index.last - first);
+    if (index.count > streamSize / smallest) {
+      return std::nullopt;
+    }
+    auto previous = std::uint64_t{};
+    for (auto j = size_type{}; j < nChunks; ++j) {
+      auto const offset = index.offset(j);
+      if ((j == 0U) != (offset == 0U) || (j != 0U && offset <= previous) ||
+          offset >= streamSize) {
+        return std::nullopt;
+      }
+      if (j != 0U && index.stride > (offset - previous) / smallest) {
+        return std::nullopt;
+      }
+      previous = offset;
+    }
+    if (nChunks != 0U &&
+        index.count - (nChunks - 1U) * index.stride >
+            (streamSize - previous) / smallest) {
+      return std::nullopt;
+    }
+    if (total != index.count) {
+      return std::nullopt;
+    }
+    return index;
+  }
+
+  // Number of elements, usable to reserve before decoding
+  [[nodiscard]] auto size() const -> size_type { return count; }
+  // Number of elements holding alternative i
+  [[nodiscard]] auto count_of(size_type const i) const -> size_type {
+    return vahinternal::loadUnaligned<std::uint64_t>(
+        alternativeCounts + i * sizeof(std::uint64_t));
+  }
+  template <class T>
+  [[nodiscard]] auto count_of() const -> size_type {
+    return count_of(VariantIndex<V, T>);
+  }
+
+  // The elements without the footer
+  [[nodiscard]] auto stream() const -> view_type { return {first, last}; }
+  // The stream split at every stride-th element, each chunk decodes on its
+  // own
+  [[nodiscard]] auto chunks() const -> size_type {
+    return static_cast<size_type>(alternativeCounts - offsets) /
+           sizeof(std::uint64_t);
+  }
+  // Elements in every chunk but the last
+  [[nodiscard]] auto chunk_size() const -> size_type { return stride; }
+  [[nodiscard]] auto chunk(size_type const j) const -> view_type {
+    auto const chunkLast =
+        j + 1U < chunks() ? first + offset(j + 1U) : last;
+    return {first + offset(j), chunkLast};
+  }
+  // Iterator to element k, k must be less than size()
+  [[nodiscard]] auto seek(size_type const k) const ->
+      typename view_type::iterator {
+    auto it = view_type{first + offset(k / stride), last}.begin();
+    std::advance(it, k % stride);
+    return it;
+  }
+
+ private:
+  [[nodiscard]] auto offset(size_type const j) const -> std::uint64_t {
+    return vahinternal::loadUnaligned<std::uint64_t>(
+        offsets + j * sizeof(std::uint64_t));
+  }
+
+  std::byte const* first{};
+  std::byte const* last{};
+  std::byte const* offsets{};
+  std::byte const* alternativeCounts{};
+  size_type count{};
+  size_type stride{};
+};
+}  // namespace csari::vah